@@ -29,12 +29,12 @@ struct door {
     bool is_choosen;
     ssize_t reachable_state;
 
-    door() : door(true, true, -1) {}
-    door(const door& ) = default;
-    door(door&& ) = default;
-    door& operator=(const door& ) = default;
-    door& operator=(door&& ) = default;
-    door(bool bricked, bool wrongDoor, size_t reachableState) : bricked(bricked), wrong_door(wrongDoor),
+    constexpr door() : door(true, true, -1) {}
+    constexpr door(const door& ) = default;
+    constexpr door(door&& ) = default;
+    constexpr door& operator=(const door& ) = default;
+    constexpr door& operator=(door&& ) = default;
+    constexpr door(bool bricked, bool wrongDoor, size_t reachableState) : bricked(bricked), wrong_door(wrongDoor),
     reachable_state(reachableState), is_choosen{false} {}
 };
 
@@ -86,32 +86,132 @@ void second_scenario(board& board) {
     }
 }
 
+#include <array>
+#include <cassert>
+
+/**
+ * Stack of booleans of bounded size, not requiring any heap allocation. The capacity is never checked outside of
+ * debug builds, so it must be proven large enough for its use.
+ */
+template <size_t Capacity>
+struct navigation_stack {
+    std::array<bool, Capacity> values{};
+    size_t count = 0;
+
+    constexpr void emplace_back(bool value) {
+        assert(count < Capacity);
+        values[count++] = value;
+    }
+    constexpr void clear() {
+        count = 0;
+    }
+    constexpr const bool* begin() const {
+        return values.data();
+    }
+    constexpr const bool* end() const {
+        return values.data() + count;
+    }
+};
+
+/**
+ * Board whose size is known at compile time, so that it can be entirely stored in arrays. As in board, the final
+ * state has no doors, and therefore its doors are never accessed.
+ */
+template <size_t States, size_t Doors>
+struct static_board {
+    static_assert(States > 0);
+    static constexpr size_t total_states = States;
+    static constexpr size_t doors = Doors;
+    static constexpr size_t start_state = 0;
+    static constexpr size_t end_state = States-1;
+
+    std::array<std::array<door, Doors>, States> transitions_from_states;
+    // navigate pushes at most one value per attempt, as long as its callbacks do the same. Each door is attempted at
+    // most once when the doors are marked as choosen, and otherwise at most once per rightness of the path, as the
+    // navigation stops as soon as it attempts again the same door with the same rightness
+    navigation_stack<2 * States * Doors> state_navigation;
+
+    static constexpr size_t door_count(size_t state) {
+        return (state != end_state) ? Doors : 0;
+    }
+};
+
+/**
+ * @return The board of first_scenario, generated at compile time
+ */
+template <size_t States, size_t Doors>
+constexpr static_board<States, Doors> first_scenario_board() {
+    static_board<States, Doors> board;
+    size_t i = 0;
+    for (size_t state = 0; state<States; state++) {
+        if (board.door_count(state) != 0) {
+            door& last = board.transitions_from_states[state][Doors-1];
+            last.bricked = false;
+            last.wrong_door = false;
+            last.reachable_state = (ssize_t)++i;
+        }
+    }
+    return board;
+}
+
+/**
+ * @return The board of second_scenario, generated at compile time
+ */
+template <size_t States, size_t Doors>
+constexpr static_board<States, Doors> second_scenario_board() {
+    static_board<States, Doors> board;
+    for (size_t state = 0; state<States; state++) {
+        for (size_t j = 0, N = board.door_count(state); j<N; j++) {
+            door& ref = board.transitions_from_states[state][j];
+            ref.bricked = false;
+            ref.reachable_state = (ssize_t)(state+1);
+            if (j == (N-1)) {
+                ref.wrong_door = false;
+            }
+        }
+    }
+    return board;
+}
+
+// The size of our production boards
+constexpr size_t production_states = 4;
+constexpr size_t production_doors = 6;
+static_assert(second_scenario_board<production_states, production_doors>().transitions_from_states[0][production_doors-1].wrong_door == false);
+
 #include <functional>
 #include <iostream>
+#include <limits>
+#include "trace.h"
 
-bool current_door_step(board& board,
+/**
+ * Both the callbacks and the board are template parameters, so that boards whose size is known at compile time are
+ * navigated without allocating any memory
+ */
+template <typename Board, typename OnWrongDoor>
+bool current_door_step(Board& board,
                        size_t& curr_state,
                        door& d,
                        size_t& door_id,
                        size_t& attempts,
                        bool set_choosen,
-                       std::function<bool(size_t&, struct board&, struct door&)> f) {
+                       OnWrongDoor f,
+                       bool verbose = true) {
 
     if (set_choosen) {
         // Never choose a previously choosen door: continue with the iteration
         if (d.is_choosen) return false;
-        std::cout << "   * Current Door = " << door_id << std::endl;
+        if (verbose) std::cout << "   * Current Door = " << door_id << std::endl;
         d.is_choosen = true;
     }
 
     attempts++;
     if (d.bricked) {
-        std::cout << "   Door is bricked!" << std::endl;
+        if (verbose) std::cout << "   Door is bricked!" << std::endl;
     } else if (d.wrong_door) {
-        std::cout << "   Wrong door!" << std::endl;
+        if (verbose) std::cout << "   Wrong door!" << std::endl;
         return f(curr_state, board, d);
     } else {
-        std::cout << "   Moving towards state #" << (size_t)d.reachable_state << std::endl;
+        if (verbose) std::cout << "   Moving towards state #" << (size_t)d.reachable_state << std::endl;
         curr_state = (size_t)d.reachable_state;
         board.state_navigation.emplace_back(true);
         return true; // Killing the iteration!
@@ -119,35 +219,285 @@ bool current_door_step(board& board,
     return false; // Do not kill the iteration
 }
 
-void navigate(board& board,
-              bool worst_case_scenario,
-              bool set_choosen,
-              std::function<bool(size_t&, struct board&, struct door&)> on_wrong_door_do,
-              std::function<void(size_t&, struct board&)> on_wrong_state_do) {
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+/**
+ * Which states and doors of a board matter, computed in time linear in the number of doors. A door can be crossed if
+ * it is neither bricked nor wrong: a board is solvable if the end state can be reached from the start state through
+ * such doors. The vectors are overwritten by each analysis, so that their memory can be reused.
+ */
+struct board_analysis {
+    static constexpr size_t unreachable = std::numeric_limits<size_t>::max();
+
+    std::vector<size_t> distance;           // Least doors to cross from the start state, if reachable
+    std::vector<bool> coreachable;          // Whether the end state can be reached from the state
+    std::vector<size_t> first_viable;       // The viable doors of each state start at first_viable[state]
+    std::vector<uint32_t> viable_doors;     // Positions of the doors crossable from reachable states towards
+                                            // coreachable states, i.e. lying on some path to the end state
+    // Scratch memory
+    std::vector<size_t> queue;
+    std::vector<size_t> first_source;
+    std::vector<size_t> sources;
+
+    bool solvable(size_t end_state) const {
+        return distance[end_state] != unreachable;
+    }
+
+    /**
+     * @return The least number of attempts needed to reach the end state, i.e. the attempts of the best case
+     */
+    size_t shortestPath(size_t end_state) const {
+        return distance[end_state];
+    }
+
+    std::span<const uint32_t> viableDoors(size_t state) const {
+        return {viable_doors.data() + first_viable[state], first_viable[state+1] - first_viable[state]};
+    }
+
+    /**
+     * @return Whether a door lies on some path to the end state. Only the doors of the states reachable from the
+     *         start state are known, so the doors of the other ones, which are only met when the navigation is moved
+     *         by its callbacks, are always worth attempting
+     */
+    bool worthAttempting(size_t state, size_t door_position) const {
+        if (distance[state] == unreachable) return true;
+        std::span<const uint32_t> doors = viableDoors(state);
+        return std::find(doors.begin(), doors.end(), (uint32_t)door_position) != doors.end();
+    }
+};
+
+template <typename Board>
+bool can_cross(const Board& board, size_t state, size_t door_position) {
+    const door& d = board.transitions_from_states[state][door_position];
+    return (!d.bricked) && (!d.wrong_door) && (d.reachable_state >= 0) &&
+           ((size_t)d.reachable_state < board.total_states);
+}
+
+/**
+ * Breadth-first visits from the start state through the crossable doors, and from the end state through the same
+ * doors backwards
+ */
+template <typename Board>
+void analyse_board(const Board& board, board_analysis& result) {
+    size_t N = board.total_states;
+    result.distance.assign(N, board_analysis::unreachable);
+    result.coreachable.assign(N, false);
+    result.first_viable.assign(N+1, 0);
+    result.viable_doors.clear();
+    if (N == 0) return;
+
+    std::vector<size_t>& queue = result.queue;
+    queue.clear();
+    queue.push_back(board.start_state);
+    result.distance[board.start_state] = 0;
+    for (size_t head = 0; head<queue.size(); head++) {
+        size_t state = queue[head];
+        if (state == board.end_state) continue;
+        for (size_t j = 0, M = board.transitions_from_states[state].size(); j<M; j++) {
+            if (!can_cross(board, state, j)) continue;
+            size_t next = (size_t)board.transitions_from_states[state][j].reachable_state;
+            if (result.distance[next] == board_analysis::unreachable) {
+                result.distance[next] = result.distance[state] + 1;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    // Incoming crossable doors of each state, as compressed rows
+    result.first_source.assign(N+1, 0);
+    for (size_t state = 0; state<N; state++) {
+        if (state == board.end_state) continue;
+        for (size_t j = 0, M = board.transitions_from_states[state].size(); j<M; j++)
+            if (can_cross(board, state, j))
+                result.first_source[board.transitions_from_states[state][j].reachable_state + 1]++;
+    }
+    for (size_t state = 0; state<N; state++)
+        result.first_source[state+1] += result.first_source[state];
+    result.sources.resize(result.first_source[N]);
+    {
+        std::vector<size_t>& fill = queue;      // Reused as the next free slot of each row
+        fill.assign(result.first_source.begin(), result.first_source.end()-1);
+        for (size_t state = 0; state<N; state++) {
+            if (state == board.end_state) continue;
+            for (size_t j = 0, M = board.transitions_from_states[state].size(); j<M; j++)
+                if (can_cross(board, state, j))
+                    result.sources[fill[board.transitions_from_states[state][j].reachable_state]++] = state;
+        }
+    }
+
+    queue.clear();
+    queue.push_back(board.end_state);
+    result.coreachable[board.end_state] = true;
+    for (size_t head = 0; head<queue.size(); head++) {
+        size_t state = queue[head];
+        for (size_t k = result.first_source[state], K = result.first_source[state+1]; k<K; k++) {
+            if (!result.coreachable[result.sources[k]]) {
+                result.coreachable[result.sources[k]] = true;
+                queue.push_back(result.sources[k]);
+            }
+        }
+    }
+
+    for (size_t state = 0; state<N; state++) {
+        if ((state != board.end_state) && (result.distance[state] != board_analysis::unreachable)) {
+            for (size_t j = 0, M = board.transitions_from_states[state].size(); j<M; j++)
+                if (can_cross(board, state, j) &&
+                    result.coreachable[board.transitions_from_states[state][j].reachable_state])
+                    result.viable_doors.push_back((uint32_t)j);
+        }
+        result.first_viable[state+1] = result.viable_doors.size();
+    }
+}
+
+/**
+ * Doors crossed since the navigation last restarted from the start state. As each door leads to a known state, only
+ * the position of each door within its state is stored.
+ */
+struct navigation_trace {
+    std::vector<uint32_t> doors;
+
+    /**
+     * @return The states met along the path, starting from the start state
+     */
+    template <typename Board>
+    std::vector<size_t> states(const Board& board) const {
+        std::vector<size_t> result{board.start_state};
+        for (uint32_t door_position : doors)
+            result.push_back((size_t)board.transitions_from_states[result.back()][door_position].reachable_state);
+        return result;
+    }
+};
+
+/**
+ * How a navigation ended
+ */
+enum navigation_end {
+    Solved = 0,
+    NoDoorLeft = 1,             // No door (or configuration) is left to be attempted
+    AttemptsExhausted = 2,
+    LoopDetected = 3            // The navigation met again a configuration, and it would cycle forever
+};
+
+struct navigation_result {
+    size_t attempts;
+    navigation_end reason;
+    navigation_trace path;
+    size_t pruned = 0;          // Doors or configurations skipped without attempting them, as they cannot win
+
+    bool solved() const {
+        return reason == Solved;
+    }
+};
+
+/**
+ * When the doors are never marked as choosen, the board does not change during the navigation. Then, attempting
+ * the same door of the same state twice, while the path crossed since the last restart is equally right or wrong,
+ * means that the navigation went back to a configuration it already met. This assumes that the callbacks only
+ * depend on the current state, on the board and on the door.
+ *
+ * @param verbose       Whether each step is printed
+ * @param max_attempts  The navigation gives up once this many doors were attempted. It also gives up when no door
+ *                      of the current state can be attempted anymore, or when a loop is detected
+ * @param analysis      If given, the doors lying on no path to the end state are skipped
+ */
+template <typename Board, typename OnWrongDoor, typename OnWrongState>
+navigation_result navigate(Board& board,
+                           bool worst_case_scenario,
+                           bool set_choosen,
+                           OnWrongDoor on_wrong_door_do,
+                           OnWrongState on_wrong_state_do,
+                           bool verbose = true,
+                           size_t max_attempts = std::numeric_limits<size_t>::max(),
+                           const board_analysis* analysis = nullptr) {
     size_t attempts = 0;
+    size_t pruned = 0;
     size_t curr_state = board.start_state;
-    if (worst_case_scenario)
-        std::cout << "Simulating the Worst Case Scenario" << std::endl;
-    else
-        std::cout << "Simulating the Best Case Scenario" << std::endl;
+    navigation_trace path;
+    if (verbose) {
+        if (worst_case_scenario)
+            std::cout << "Simulating the Worst Case Scenario" << std::endl;
+        else
+            std::cout << "Simulating the Best Case Scenario" << std::endl;
+    }
+
+    // One bit per door and per rightness of the path, where the doors of each state start at first_door[state]
+    bool track_loops = !set_choosen;
+    std::vector<size_t> first_door;
+    std::vector<uint64_t> visited;
+    if (track_loops) {
+        first_door.resize(board.total_states+1, 0);
+        for (size_t state = 0; state<board.total_states; state++)
+            first_door[state+1] = first_door[state] + board.transitions_from_states[state].size();
+        visited.resize((first_door.back() * 2 + 63) / 64, 0);
+    }
+    bool path_is_ok = true;
+    bool loop_detected = false;
+    auto attempt = [&](door& d, size_t& door_id) {
+        if (analysis && (!analysis->worthAttempting(curr_state, door_id - 1))) {
+            pruned++;
+            return false;
+        }
+        if (track_loops) {
+            size_t bit = ((first_door[curr_state] + door_id - 1) << 1) | (size_t)path_is_ok;
+            uint64_t mask = ((uint64_t)1) << (bit & 63);
+            if (visited[bit >> 6] & mask) {
+                loop_detected = true;
+                return true;
+            }
+            visited[bit >> 6] |= mask;
+        }
+        size_t from = curr_state;
+        bool stop = current_door_step(board, curr_state, d, door_id, attempts, set_choosen, on_wrong_door_do, verbose);
+        if (stop && (((!d.bricked) && (!d.wrong_door)) || (curr_state != from)))
+            path.doors.push_back((uint32_t)(door_id - 1));
+        return stop;
+    };
+
     while (curr_state != board.end_state) {
-        std::cout << " * Current State = " << curr_state << std::endl;
+        if (attempts >= max_attempts) {
+            if (verbose) std::cout << "Giving up after " << attempts << " attempts" << std::endl;
+            return {attempts, AttemptsExhausted, std::move(path), pruned};
+        }
+        if (verbose) std::cout << " * Current State = " << curr_state << std::endl;
+        path_is_ok = true;
+        for (bool v : board.state_navigation) {
+            if (!v) {
+                path_is_ok = false;
+                break;
+            }
+        }
         size_t i = 0;
+        size_t previous_attempts = attempts;
         if (worst_case_scenario) {
             i = 1;
             auto en = board.transitions_from_states[curr_state].end();
             for (auto it = board.transitions_from_states[curr_state].begin(); it != en; it++) {
-                if (current_door_step(board, curr_state, *it, i, attempts, set_choosen, on_wrong_door_do)) break;
+                if (attempt(*it, i)) break;
                 i++;
             }
         } else {
             i = board.transitions_from_states[curr_state].size();
             auto en = board.transitions_from_states[curr_state].rend();
             for (auto it = board.transitions_from_states[curr_state].rbegin(); it != en; it++) {
-                if (current_door_step(board, curr_state, *it, i, attempts, set_choosen, on_wrong_door_do)) break;
+                if (attempt(*it, i)) break;
                 i--;
             }
         }
+        if (loop_detected) {
+            if (verbose) {
+                std::cout << "Loop detected after " << attempts << " attempts, along the states";
+                for (size_t state : path.states(board))
+                    std::cout << ' ' << state;
+                std::cout << std::endl;
+            }
+            return {attempts, LoopDetected, std::move(path), pruned};
+        }
+        if (attempts == previous_attempts) {
+            if (verbose) std::cout << "No door left to attempt" << std::endl;
+            return {attempts, NoDoorLeft, std::move(path), pruned};
+        }
         if (curr_state == board.end_state) {
             bool is_ok = true;
             for (bool v : board.state_navigation) {
@@ -156,14 +506,19 @@ void navigate(board& board,
                     break;
                 }
             }
-            if (!is_ok)
+            if (!is_ok) {
                 on_wrong_state_do(curr_state, board);
+                if (curr_state != board.end_state)
+                    path.doors.clear();
+            }
         }
     }
-    std::cout << "Total attempts = " << attempts << std::endl;
+    if (verbose) std::cout << "Total attempts = " << attempts << std::endl;
+    return {attempts, Solved, std::move(path), pruned};
 }
 
 void first_run() {
+    scoped_timer timer{"first_run"};
     auto on_wrong_do_nothing = [](size_t&, struct board&, struct door&) {return true;};
     auto all_final_states_are_ok = [](size_t&, struct board&) {};
 
@@ -179,7 +534,30 @@ void first_run() {
     }
 }
 
+/**
+ * Same as first_run, over the board known at compile time, which must take as many attempts as the runtime one
+ */
+void first_run_static() {
+    scoped_timer timer{"first_run_static"};
+    auto on_wrong_do_nothing = [](size_t&, auto&, struct door&) {return true;};
+    auto all_final_states_are_ok = [](size_t&, auto&) {};
+
+    for (bool worst_case_scenario : {true, false}) {
+        board default_board;
+        first_scenario(default_board);
+        auto production_board = first_scenario_board<production_states, production_doors>();
+        size_t expected = navigate(default_board, worst_case_scenario, true, on_wrong_do_nothing,
+                                   all_final_states_are_ok, false).attempts;
+        size_t attempts = navigate(production_board, worst_case_scenario, true, on_wrong_do_nothing,
+                                   all_final_states_are_ok, false).attempts;
+        std::cout << (worst_case_scenario ? "Worst" : "Best") << " case attempts over the compile-time board: "
+                  << attempts << " (runtime board: " << expected << ")" << std::endl;
+        assert(attempts == expected);
+    }
+}
+
 void second_run(bool set_choosen = false) {
+    scoped_timer timer{"second_run"};
     auto on_wrong_do_ignore_backtrack_later = [](size_t& curr_state, struct board& board, struct door& d) {
         std::cout << "   Moving towards state #" << ((size_t)d.reachable_state)<< std::endl;
         curr_state = (size_t)d.reachable_state;
@@ -204,173 +582,824 @@ void second_run(bool set_choosen = false) {
     }
 }
 
-#include <yaucl/hashing/hash_combine.h>
-#include <yaucl/hashing/pair_hash.h>
-#include <unordered_set>
-#include <unordered_map>
-#include <array>
+/**
+ * Doors of the first three states that a configuration search attempts, together with the configurations it skipped
+ */
+struct configuration_pruning {
+    std::array<uint64_t, 3> viable;     // One bit per door of each state
+    size_t pruned = 0;
 
-void third_run_sequential() {
+    configuration_pruning() {
+        viable.fill(~(uint64_t)0);
+    }
 
-    board default_board;
-    second_scenario(default_board);
-
-    // Remembering the wrong configurations
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s1_position_to_other_choices{6};
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s2_position_to_other_choices{6};
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s3_position_to_other_choices{6};
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s1_s2_position_to_other_choices;
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s1_s3_position_to_other_choices;
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s2_s3_position_to_other_choices;
-    std::unordered_set<std::pair<size_t, std::pair<size_t, size_t>>>          s1_s2_s3_attempts; // Not necessary here!
+    /**
+     * Only attempts the doors lying on some path to the end state
+     */
+    explicit configuration_pruning(const board_analysis& analysis) : viable{} {
+        for (size_t state = 0; state<viable.size(); state++)
+            for (size_t door_position = 0; door_position<64; door_position++)
+                if ((state >= analysis.distance.size()) || analysis.worthAttempting(state, door_position))
+                    viable[state] |= ((uint64_t)1) << door_position;
+    }
+
+    bool isViable(size_t state, size_t door_position) const {
+        return (viable[state] >> door_position) & 1;
+    }
+
+    /**
+     * @return The doors of a state that are attempted
+     */
+    template <size_t Doors>
+    size_t countViable(size_t state) const {
+        size_t count = 0;
+        for (size_t door_position = 0; door_position<Doors; door_position++)
+            count += isViable(state, door_position);
+        return count;
+    }
+};
+
+/**
+ * Tries the configurations of the doors of the first three states in lexicographic order until a winning one is
+ * found. As each configuration is met only once, there is no need to remember the wrong ones.
+ *
+ * @param isWrong   Whether the configuration (i, j, k) leads to a wrong door
+ * @param pruning   If given, the configurations having a door not worth attempting are skipped, and counted
+ * @return The number of configurations attempted, or 0 if none of them wins
+ */
+template <size_t Doors, typename WrongConfiguration>
+size_t sequential_configuration_search(WrongConfiguration&& isWrong, bool debug,
+                                       configuration_pruning* pruning = nullptr) {
+    static_assert(Doors <= 64, "The viable doors are stored as bits");
     // Counting the attempts
     size_t attempts = 0;
 
-    for (size_t i = 0; i<6; i++) {
-        if (s1_position_to_other_choices.at(i).size() == 36)  {
-            std::cout << "Skipping door@s=" << i << std::endl;
+    for (size_t i = 0; i<Doors; i++) {
+        if (pruning && (!pruning->isViable(0, i))) {
+            pruning->pruned += Doors * Doors;
             continue;
         }
-
-        for (size_t j = 0; j<6; j++) {
-            if (s2_position_to_other_choices.at(j).size() == 36) {
-                std::cout << "Skipping door@s1=" << j << std::endl;
+        for (size_t j = 0; j<Doors; j++) {
+            if (pruning && (!pruning->isViable(1, j))) {
+                pruning->pruned += Doors;
                 continue;
             }
-            {
-                auto it = s1_s2_position_to_other_choices.find({i,j});
-                if (it != s1_s2_position_to_other_choices.end() && it->second.size() == 6) {
-                    std::cout << "Skipping door@s=" << i << " and door@s1=" << j << std::endl;
+            for (size_t k = 0; k<Doors; k++) {
+                if (pruning && (!pruning->isViable(2, k))) {
+                    pruning->pruned++;
                     continue;
                 }
-            }
-
-            for (size_t k = 0; k<6; k++) {
-                if (s3_position_to_other_choices.at(k).size() == 36) continue;
-                {
-                    auto it = s1_s3_position_to_other_choices.find({i,k});
-                    if (it != s1_s3_position_to_other_choices.end() && it->second.size() == 6) {
-                        std::cout << "Skipping door@s=" << i << " and door@s2=" << k << std::endl;
-                        continue;
-                    }
-                }
-                {
-                    auto it = s2_s3_position_to_other_choices.find({j,k});
-                    if (it != s2_s3_position_to_other_choices.end() && it->second.size() == 6) {
-                        std::cout << "Skipping door@s1=" << j << " and door@s2=" << k << std::endl;
-                        continue;
-                    }
-                }
-                if (s1_s2_s3_attempts.contains({i, {j, k}})) {
-                    std::cout << "Skipping " << i << ' ' << j << ' ' << k << "!" << std::endl;
-                    continue;
-                }
-
-                if (default_board.transitions_from_states.at(0).at(i).wrong_door ||
-                    default_board.transitions_from_states.at(1).at(j).wrong_door ||
-                    default_board.transitions_from_states.at(2).at(k).wrong_door) {
-                    std::cout << "Wrong configuration: " << i << ' ' << j << ' ' << k << "!" << std::endl;
-                    s1_position_to_other_choices[i].insert({j,k});
-                    s2_position_to_other_choices[j].insert({i,k});
-                    s3_position_to_other_choices[k].insert({i,j});
-                    s1_s2_position_to_other_choices[{i,j}].insert(k);
-                    s1_s3_position_to_other_choices[{i,k}].insert(j);
-                    s2_s3_position_to_other_choices[{j,k}].insert(i);
-                    s1_s2_s3_attempts.insert({i, {j,k}});
-                    attempts++;
-                } else {
-                    std::cout << "Winning configuration: " << i << ' ' << j << ' ' << k << '!' << std::endl;
+                if (!isWrong(i, j, k)) {
+                    if (debug) std::cout << "Winning configuration: " << i << ' ' << j << ' ' << k << '!' << std::endl;
+                    if (debug) std::cout << "attempts: " << (attempts+1) << std::endl;
+                    return (attempts+1);
                 }
+                if (debug) std::cout << "Wrong configuration: " << i << ' ' << j << ' ' << k << "!" << std::endl;
+                attempts++;
             }
         }
     }
+    return 0;
+}
+
+void third_run_sequential() {
+    scoped_timer timer{"third_run_sequential"};
+
+    board default_board = [] {
+        scoped_timer construction{"board construction"};
+        board result;
+        second_scenario(result);
+        return result;
+    }();
 
-    std::cout << "attempts: " << (attempts+1) << std::endl;
+    sequential_configuration_search<6>([&default_board](size_t i, size_t j, size_t k) {
+        return default_board.transitions_from_states.at(0).at(i).wrong_door ||
+               default_board.transitions_from_states.at(1).at(j).wrong_door ||
+               default_board.transitions_from_states.at(2).at(k).wrong_door;
+    }, true);
 }
 
 #include <random>
-#include <cassert>
+
+/**
+ * Set of at most Capacity doors, supporting both the uniform sampling and the removal of a door in constant time: the
+ * doors still in the set are kept at the beginning of an array, and a removed door is swapped with the last one
+ */
+template <size_t Capacity>
+struct door_sampler {
+    std::array<size_t, Capacity> doors;
+    std::array<size_t, Capacity> slots;     // Position of each door within doors
+    size_t count;
+
+    door_sampler() : count{Capacity} {
+        for (size_t door = 0; door<Capacity; door++)
+            doors[door] = slots[door] = door;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    template <typename Generator>
+    size_t sample(Generator& generator) const {
+        assert(count > 0);
+        std::uniform_int_distribution<size_t> slot_distr(0, count-1);
+        return doors[slot_distr(generator)];
+    }
+
+    void erase(size_t door) {
+        size_t slot = slots[door];
+        assert(slot < count);
+        size_t last = doors[--count];
+        doors[slot] = last;
+        slots[last] = slot;
+        doors[count] = door;
+        slots[door] = count;
+    }
+};
+
+/**
+ * Randomly tries the configurations of the doors of the first three states, never attempting the same configuration
+ * twice, until a winning one is found. Each door is drawn among the ones still leading to an untried configuration,
+ * so that each choice costs exactly one draw.
+ *
+ * @param isWrong   Whether the configuration (i, j, k) leads to a wrong door
+ * @param pruning   If given, the configurations having a door not worth attempting are never drawn, and counted
+ * @return The number of configurations attempted, or 0 if none of them wins
+ */
+template <size_t Doors, typename Generator, typename WrongConfiguration>
+size_t random_configuration_search(Generator& generator_s1, Generator& generator_s2, Generator& generator_s3,
+                                   WrongConfiguration&& isWrong, bool debug,
+                                   configuration_pruning* pruning = nullptr) {
+    static_assert(Doors <= 64, "The viable doors are stored as bits");
+    // The doors still having untried configurations: for the first state, for the second state once chosen i, and
+    // for the third state once chosen i and j
+    door_sampler<Doors>                 s1_choices;
+    std::array<door_sampler<Doors>, Doors> s1_s2_choices;
+    std::vector<door_sampler<Doors>>    s1_s2_s3_choices(Doors * Doors);
+    // Counting the attempts
+    size_t attempts = 0;
+
+    if (pruning) {
+        size_t viable = pruning->countViable<Doors>(0) * pruning->countViable<Doors>(1) * pruning->countViable<Doors>(2);
+        pruning->pruned += Doors * Doors * Doors - viable;
+        if (viable == 0)
+            return 0;
+        // As each state keeps some door, no sampler is left empty
+        for (size_t i = 0; i<Doors; i++) {
+            if (!pruning->isViable(0, i)) s1_choices.erase(i);
+            if (!pruning->isViable(1, i))
+                for (door_sampler<Doors>& choices : s1_s2_choices) choices.erase(i);
+            if (!pruning->isViable(2, i))
+                for (door_sampler<Doors>& choices : s1_s2_s3_choices) choices.erase(i);
+        }
+    }
+
+    while (!s1_choices.empty()) {
+        size_t i = s1_choices.sample(generator_s1);
+        size_t j = s1_s2_choices[i].sample(generator_s2);
+        size_t k = s1_s2_s3_choices[i * Doors + j].sample(generator_s3);
+
+        if (!isWrong(i, j, k)) {
+            if (debug) std::cout << "Winning configuration: " << i << ' ' << j << ' ' << k << '!' << std::endl;
+            if (debug) std::cout << "attempts: " << (attempts+1) << std::endl<< std::endl<< std::endl;
+            return (attempts+1);
+        }
+        if (debug) std::cout << "Wrong configuration: " << i << ' ' << j << ' ' << k << "!" << std::endl;
+        s1_s2_s3_choices[i * Doors + j].erase(k);
+        if (s1_s2_s3_choices[i * Doors + j].empty()) {
+            s1_s2_choices[i].erase(j);
+            if (s1_s2_choices[i].empty())
+                s1_choices.erase(i);
+        }
+        attempts++;
+    }
+    return 0;
+}
 
 size_t third_run_random(size_t generator_seed, bool debug = true) {
+    scoped_timer timer{"third_run_random"};
 
-    board default_board;
-    second_scenario(default_board);
+    board default_board = [] {
+        scoped_timer construction{"board construction"};
+        board result;
+        second_scenario(result);
+        return result;
+    }();
 
-    std::random_device  dev;
     std::mt19937_64     generator_s1(generator_seed);
     std::mt19937_64     generator_s2(generator_seed+1);
     std::mt19937_64     generator_s3(generator_seed+2);
-    std::uniform_int_distribution<size_t> door_distr(0,5);
-
-    // Remembering the wrong configurations
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s1_position_to_other_choices{6};
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s2_position_to_other_choices{6};
-    std::vector<std::unordered_set<std::pair<size_t, size_t>>>                s3_position_to_other_choices{6};
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s1_s2_position_to_other_choices;
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s1_s3_position_to_other_choices;
-    std::unordered_map<std::pair<size_t, size_t>, std::unordered_set<size_t>> s2_s3_position_to_other_choices;
-    std::unordered_set<std::pair<size_t, std::pair<size_t, size_t>>>          s1_s2_s3_attempts;
-    // Counting the attempts
-    size_t attempts = 0;
 
-    bool not_found = true;
-    while (not_found) {
-        size_t i, j, k;
-        size_t tryouts = 0;
-        do {
-            tryouts++;
-            if (debug && (tryouts > 1)) std::cout << "changing i" << std::endl;
-            i = door_distr(generator_s1);
-        } while (s1_position_to_other_choices.at(i).size() == 36);
-
-        tryouts = 0;
-        do {
-            tryouts++;
-            if (debug && (tryouts > 1))  std::cout << "changing j" << std::endl;
-            j = door_distr(generator_s2);
-        } while ((s2_position_to_other_choices.at(j).size() == 36) ||
-                 (s1_s2_position_to_other_choices[{i,j}].size() == 6));
-
-        tryouts = 0;
-        do {
-            tryouts++;
-            if (debug && (tryouts > 1))  std::cout << "changing k" << std::endl;
-            k = door_distr(generator_s3);
-        } while ((s1_s2_s3_attempts.contains({i, {j, k}})) ||
-                 (s3_position_to_other_choices.at(k).size() == 36) ||
-                 (s1_s3_position_to_other_choices[{i,k}].size() == 6) ||
-                 (s2_s3_position_to_other_choices[{j,k}].size() == 6));
-
-        if (default_board.transitions_from_states.at(0).at(i).wrong_door ||
-            default_board.transitions_from_states.at(1).at(j).wrong_door ||
-            default_board.transitions_from_states.at(2).at(k).wrong_door) {
-            if (debug) std::cout << "Wrong configuration: " << i << ' ' << j << ' ' << k << "!" << std::endl;
-            s1_position_to_other_choices[i].insert({j,k});
-            s2_position_to_other_choices[j].insert({i,k});
-            s3_position_to_other_choices[k].insert({i,j});
-            s1_s2_position_to_other_choices[{i,j}].insert(k);
-            s1_s3_position_to_other_choices[{i,k}].insert(j);
-            s2_s3_position_to_other_choices[{j,k}].insert(i);
-            s1_s2_s3_attempts.insert({i, {j,k}});
-            attempts++;
-        } else {
-            if (debug) std::cout << "Winning configuration: " << i << ' ' << j << ' ' << k << '!' << std::endl;
-            not_found = false;
+    return random_configuration_search<6>(generator_s1, generator_s2, generator_s3,
+                                          [&default_board](size_t i, size_t j, size_t k) {
+        return default_board.transitions_from_states.at(0).at(i).wrong_door ||
+               default_board.transitions_from_states.at(1).at(j).wrong_door ||
+               default_board.transitions_from_states.at(2).at(k).wrong_door;
+    }, debug);
+}
+
+#include <cstdint>
+#include <thread>
+
+/**
+ * Philox4x32-10 block function (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011): each
+ * counter is mapped to four random words by ten rounds of multiplications, independently of all the other counters
+ */
+constexpr std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) {
+    for (size_t round = 0; round<10; round++) {
+        uint64_t product0 = (uint64_t)0xD2511F53 * counter[0];
+        uint64_t product1 = (uint64_t)0xCD9E8D57 * counter[2];
+        counter = {(uint32_t)(product1 >> 32) ^ counter[1] ^ key[0], (uint32_t)product1,
+                   (uint32_t)(product0 >> 32) ^ counter[3] ^ key[1], (uint32_t)product0};
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+    return counter;
+}
+static_assert(philox4x32({0, 0, 0, 0}, {0, 0}) == std::array<uint32_t, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+
+/**
+ * Counter-based generator, where the i-th number drawn for a given trial and stream only depends on (trial, stream,
+ * i). Therefore, constructing it costs nothing, different trials never share their sequences, and the results do
+ * not depend on how the trials are distributed among the threads.
+ */
+struct philox_generator {
+    using result_type = uint64_t;
+
+    std::array<uint32_t, 2> key;
+    uint32_t stream;
+    uint64_t block = 0;                 // Each block provides two numbers
+    std::array<uint32_t, 4> words{};
+    size_t used = 4;
+
+    philox_generator(uint64_t trial, uint32_t stream) : key{(uint32_t)trial, (uint32_t)(trial >> 32)}, stream{stream} {}
+
+    static constexpr result_type min() {
+        return 0;
+    }
+    static constexpr result_type max() {
+        return UINT64_MAX;
+    }
+
+    result_type operator()() {
+        if (used == 4) {
+            words = philox4x32({(uint32_t)block, (uint32_t)(block >> 32), stream, 0}, key);
+            block++;
+            used = 0;
         }
+        result_type result = words[used] | (((result_type)words[used+1]) << 32);
+        used += 2;
+        return result;
     }
+};
+
+/**
+ * @return The generator choosing the doors of a given state during a trial
+ */
+template <typename Generator> Generator door_generator(size_t trial, size_t state);
+
+// Adjacent trials share two out of three seeds
+template <> std::mt19937_64 door_generator<std::mt19937_64>(size_t trial, size_t state) {
+    return std::mt19937_64(trial + state);
+}
+
+template <> philox_generator door_generator<philox_generator>(size_t trial, size_t state) {
+    return {trial, (uint32_t)state};
+}
+
+/**
+ * Same as third_run_random, for a board of four states known at compile time
+ */
+template <typename Generator = std::mt19937_64, size_t Doors>
+size_t third_run_random(const static_board<4, Doors>& default_board, size_t generator_seed, bool debug = true) {
+    scoped_timer timer{"third_run_random"};
 
-    if (debug) std::cout << "attempts: " << (attempts+1) << std::endl<< std::endl<< std::endl;
-    assert(attempts <= 216);
-    return (attempts+1);
+    Generator           generator_s1 = door_generator<Generator>(generator_seed, 0);
+    Generator           generator_s2 = door_generator<Generator>(generator_seed, 1);
+    Generator           generator_s3 = door_generator<Generator>(generator_seed, 2);
+
+    return random_configuration_search<Doors>(generator_s1, generator_s2, generator_s3,
+                                              [&default_board](size_t i, size_t j, size_t k) {
+        return default_board.transitions_from_states[0][i].wrong_door ||
+               default_board.transitions_from_states[1][j].wrong_door ||
+               default_board.transitions_from_states[2][k].wrong_door;
+    }, debug);
+}
+
+#include <chrono>
+#include <ostream>
+
+/**
+ * When an adaptive simulation stops. Precision targets set to zero are ignored, and the simulation never stops
+ * before min_trials trials, so that the variance estimate can be trusted.
+ */
+struct stopping_criteria {
+    double half_width = 0.0;            // Of the confidence interval of the mean
+    double relative_error = 0.0;        // Half width over the absolute value of the mean
+    double z = 1.96;                    // Normal quantile of the confidence level (95%)
+    size_t min_trials = 100;
+    size_t max_trials = std::numeric_limits<size_t>::max();
+    std::chrono::steady_clock::duration budget = std::chrono::seconds{10};
+};
+
+enum stopping_reason {
+    HalfWidthReached = 0,
+    RelativeErrorReached = 1,
+    BudgetExhausted = 2,
+    TrialsExhausted = 3
+};
+
+/**
+ * Streamed statistics of the attempts needed by each trial: Welford's running mean and variance, and a histogram of
+ * the attempt counts
+ */
+struct trial_statistics {
+    size_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;                    // Sum of the squared deviations from the mean
+    size_t min_val = std::numeric_limits<size_t>::max();
+    size_t max_val = 0;
+    std::vector<size_t> histogram;      // How many trials needed a given number of attempts
+
+    void add(size_t value) {
+        count++;
+        double delta = (double)value - mean;
+        mean += delta / (double)count;
+        m2 += delta * ((double)value - mean);
+        min_val = std::min(min_val, value);
+        max_val = std::max(max_val, value);
+        if (histogram.size() <= value)
+            histogram.resize(value+1, 0);
+        histogram[value]++;
+    }
+
+    double variance() const {
+        return (count > 1) ? m2 / (double)(count-1) : std::numeric_limits<double>::infinity();
+    }
+
+    double halfWidth(double z) const {
+        return z * std::sqrt(variance() / (double)count);
+    }
+
+    /**
+     * @param q     Fraction of the trials, between 0 and 1
+     * @return The least number of attempts which was enough for that fraction of the trials
+     */
+    size_t quantile(double q) const {
+        size_t seen = 0;
+        for (size_t value = 0; value<histogram.size(); value++) {
+            seen += histogram[value];
+            if ((double)seen >= q * (double)count)
+                return value;
+        }
+        return max_val;
+    }
+};
+
+struct simulation_report {
+    trial_statistics statistics;
+    stopping_reason reason;
+    double half_width;
+    double relative_error;
+    double elapsed_seconds;
+
+    friend std::ostream &operator<<(std::ostream &os, const simulation_report &report) {
+        static const char* reasons[] = {"half width reached", "relative error reached", "time budget exhausted",
+                                        "trials exhausted"};
+        const trial_statistics& stats = report.statistics;
+        os << "trials: " << stats.count << " (" << reasons[report.reason] << " after " << report.elapsed_seconds
+           << "s)" << std::endl;
+        os << "MIN = " << stats.min_val << " MAX = " << stats.max_val << " median = " << stats.quantile(0.5)
+           << " 95th percentile = " << stats.quantile(0.95) << std::endl;
+        os << "Average = " << stats.mean << " +/- " << report.half_width << " (relative error "
+           << report.relative_error << ")";
+        return os;
+    }
+};
+
+/**
+ * Runs trials until the confidence interval of the mean is as narrow as requested, or the time budget runs out.
+ * The clock is read every 64 trials.
+ *
+ * @param trial     Returns the attempts needed by the i-th trial
+ */
+template <typename Trial>
+simulation_report adaptive_simulation(Trial&& trial, const stopping_criteria& criteria) {
+    scoped_timer timer{"adaptive_simulation"};
+    simulation_report report{{}, TrialsExhausted, std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::infinity(), 0.0};
+    trial_statistics& stats = report.statistics;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i<criteria.max_trials; i++) {
+        stats.add(trial(i));
+        if (stats.count < std::max<size_t>(criteria.min_trials, 2)) continue;
+        report.half_width = stats.halfWidth(criteria.z);
+        report.relative_error = report.half_width / std::abs(stats.mean);
+        if ((criteria.half_width > 0.0) && (report.half_width <= criteria.half_width)) {
+            report.reason = HalfWidthReached;
+            break;
+        }
+        if ((criteria.relative_error > 0.0) && (report.relative_error <= criteria.relative_error)) {
+            report.reason = RelativeErrorReached;
+            break;
+        }
+        if (((stats.count % 64) == 0) && (std::chrono::steady_clock::now() - start >= criteria.budget)) {
+            report.reason = BudgetExhausted;
+            break;
+        }
+    }
+    report.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+#include <atomic>
+#include <iomanip>
+
+/**
+ * Random boards where each door is independently bricked or wrong, and leads either to the next state or, through a
+ * back edge, to a state already met. The i-th board only depends on the seed and on i.
+ */
+struct board_population {
+    size_t boards = 10000;
+    size_t states = production_states;
+    size_t doors = production_doors;
+    double bricked_probability = 0.2;
+    double wrong_probability = 0.5;     // Of a door which is not bricked
+    double back_edge_probability = 0.0;
+    bool solvable = true;               // Whether each state always has a correct door towards the next one
+    size_t seed = 0;
+
+    /**
+     * Overwrites a board with the index-th board of the population, reusing its memory when it has the same size
+     */
+    void generate(size_t index, board& result) const {
+        result.total_states = states;
+        result.start_state = 0;
+        result.end_state = (states == 0 ? 0 : states-1);
+        result.state_navigation.clear();
+        result.transitions_from_states.resize(states);
+
+        philox_generator generator{seed, (uint32_t)index};
+        std::bernoulli_distribution bricked_distr(bricked_probability), wrong_distr(wrong_probability),
+                                    back_edge_distr(back_edge_probability);
+        for (size_t state = 0; state<states; state++) {
+            std::vector<door>& adj = result.transitions_from_states[state];
+            adj.resize((state != result.end_state) ? doors : 0);
+            bool has_correct_door = false;
+            for (door& d : adj) {
+                d.bricked = bricked_distr(generator);
+                d.wrong_door = wrong_distr(generator);
+                d.is_choosen = false;
+                d.reachable_state = (ssize_t)(state+1);
+                if (back_edge_distr(generator))
+                    d.reachable_state = (ssize_t)std::uniform_int_distribution<size_t>(0, state)(generator);
+                has_correct_door = has_correct_door ||
+                                   ((!d.bricked) && (!d.wrong_door) && (d.reachable_state == (ssize_t)(state+1)));
+            }
+            if (solvable && (!has_correct_door) && (!adj.empty()))
+                adj[std::uniform_int_distribution<size_t>(0, adj.size()-1)(generator)] =
+                        door{false, false, state+1};
+        }
+    }
+
+    board generate(size_t index) const {
+        board result{0, 0};
+        generate(index, result);
+        return result;
+    }
+};
+
+#include <sstream>
+
+/**
+ * Generates the boards of a population in batches. Each batch overwrites the boards of the previous one, so that
+ * streaming millions of boards never allocates more than a batch of them.
+ */
+struct board_stream {
+    board_population population;
+    size_t batch_size;
+    size_t next_index = 0;
+    std::vector<board> pool;
+
+    explicit board_stream(const board_population& population, size_t batch_size = 4096) :
+            population{population}, batch_size{batch_size} {}
+
+    /**
+     * @param nThreads  Threads generating the boards of the batch
+     * @return The next boards of the population, which are valid until the following call. The span is empty once
+     *         the population is over
+     */
+    std::span<board> next(size_t nThreads = 1) {
+        scoped_timer timer{"board generation", "harness"};
+        size_t count = std::min(batch_size, population.boards - next_index);
+        if (pool.size() < count)
+            pool.resize(count, board{0, 0});
+        std::atomic<size_t> next_board{0};
+        auto parallel_for = [&] {
+            for (size_t i = next_board++; i<count; i = next_board++)
+                population.generate(next_index + i, pool[i]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t<std::min(nThreads, count); t++)
+            threads.emplace_back(parallel_for);
+        parallel_for();
+        for (std::thread& t : threads)
+            t.join();
+        next_index += count;
+        return {pool.data(), count};
+    }
+};
+
+/**
+ * Compact binary file of boards having the same size. After a header storing the numbers of states and doors, each
+ * door is stored as ((reachable_state+1) << 2 | wrong_door << 1 | bricked), using as few bytes as the number of
+ * states allows.
+ */
+struct board_file {
+    static constexpr uint32_t magic = 0x44524242;   // "BBRD"
+    size_t states;
+    size_t doors;
+
+    board_file(size_t states, size_t doors) : states{states}, doors{doors} {}
+
+    size_t codeBytes() const {
+        uint64_t largest = ((uint64_t)states + 1) << 2 | 3;
+        return (largest <= UINT8_MAX) ? 1 : ((largest <= UINT16_MAX) ? 2 : 4);
+    }
+};
+
+struct board_writer : public board_file {
+    std::ostream& os;
+
+    board_writer(std::ostream& os, size_t states, size_t doors) : board_file{states, doors}, os{os} {
+        uint32_t header[3] = {magic, (uint32_t)states, (uint32_t)doors};
+        os.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    void write(const board& b) {
+        assert(b.total_states == states);
+        size_t width = codeBytes();
+        for (const std::vector<door>& adj : b.transitions_from_states) {
+            for (const door& d : adj) {
+                uint32_t code = ((uint32_t)(d.reachable_state+1) << 2) | ((uint32_t)d.wrong_door << 1) |
+                                (uint32_t)d.bricked;
+                os.write(reinterpret_cast<const char*>(&code), (std::streamsize)width);     // Little endian
+            }
+        }
+    }
+};
+
+struct board_reader : public board_file {
+    std::istream& is;
+    bool valid;
+
+    explicit board_reader(std::istream& is) : board_file{0, 0}, is{is} {
+        uint32_t header[3] = {0, 0, 0};
+        valid = (bool)is.read(reinterpret_cast<char*>(header), sizeof(header)) && (header[0] == magic);
+        states = header[1];
+        doors = header[2];
+    }
+
+    /**
+     * Overwrites a board with the next one of the file, reusing its memory
+     *
+     * @return Whether a whole board was read
+     */
+    bool read(board& b) {
+        if (!valid) return false;
+        b.total_states = states;
+        b.start_state = 0;
+        b.end_state = (states == 0 ? 0 : states-1);
+        b.state_navigation.clear();
+        b.transitions_from_states.resize(states);
+        size_t width = codeBytes();
+        for (size_t state = 0; state<states; state++) {
+            std::vector<door>& adj = b.transitions_from_states[state];
+            adj.resize((state != b.end_state) ? doors : 0);
+            for (door& d : adj) {
+                uint32_t code = 0;
+                if (!is.read(reinterpret_cast<char*>(&code), (std::streamsize)width)) return false;
+                d = door{(code & 1) != 0, (code & 2) != 0, 0};
+                d.reachable_state = (ssize_t)(code >> 2) - 1;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * Door-search policy, which is given its own copy of the board, the seed of the trial and the analysis of the board
+ */
+struct door_strategy {
+    std::string name;
+    std::function<navigation_result(board&, size_t, const board_analysis&)> run;
+    std::function<bool(const board&)> accepts = {}; // The boards the strategy can run on, if not all of them
+    bool counts_doors = true;                       // Otherwise, it counts the configurations of doors
+    bool prunes = false;                            // Whether it skips the doors lying on no path to the end state
+};
+
+/**
+ * @return All the search strategies of this file, without printing any step
+ */
+std::vector<door_strategy> door_strategies(size_t max_attempts = 1000) {
+    std::vector<door_strategy> strategies;
+    auto on_wrong_do_nothing = [](size_t&, struct board&, struct door&) {return true;};
+    auto all_final_states_are_ok = [](size_t&, struct board&) {};
+    auto on_wrong_do_ignore_backtrack_later = [](size_t& curr_state, struct board& board, struct door& d) {
+        curr_state = (size_t)d.reachable_state;
+        board.state_navigation.emplace_back(false);
+        return true;
+    };
+    auto on_wrong_final_state_backtrack = [](size_t& curr_state, struct board& board) {
+        curr_state = board.start_state;
+        board.state_navigation.clear();
+    };
+    for (bool prune : {false, true}) {
+        for (bool set_choosen : {true, false}) {
+            for (bool worst_case_scenario : {false, true}) {
+                std::string suffix = std::string{worst_case_scenario ? " worst" : " best"} +
+                                     (set_choosen ? " (set_choosen)" : "") + (prune ? " (pruned)" : "");
+                strategies.push_back({"navigate" + suffix, [=](board& b, size_t, const board_analysis& analysis) {
+                    return navigate(b, worst_case_scenario, set_choosen, on_wrong_do_nothing,
+                                    all_final_states_are_ok, false, max_attempts, prune ? &analysis : nullptr);
+                }, {}, true, prune});
+                strategies.push_back({"backtrack" + suffix, [=](board& b, size_t, const board_analysis& analysis) {
+                    return navigate(b, worst_case_scenario, set_choosen, on_wrong_do_ignore_backtrack_later,
+                                    on_wrong_final_state_backtrack, false, max_attempts, prune ? &analysis : nullptr);
+                }, {}, true, prune});
+            }
+        }
+    }
+    // A configuration is wrong if any of its doors cannot be crossed towards the next state
+    auto is_wrong = [](const board& b) {
+        return [&b](size_t i, size_t j, size_t k) {
+            auto cannot_cross = [&b](size_t state, size_t door_id) {
+                const door& d = b.transitions_from_states[state][door_id];
+                return d.bricked || d.wrong_door || (d.reachable_state != (ssize_t)(state+1));
+            };
+            return cannot_cross(0, i) || cannot_cross(1, j) || cannot_cross(2, k);
+        };
+    };
+    // The configurations are only defined over the production boards
+    auto is_production_board = [](const board& b) {
+        return (b.total_states == production_states) &&
+               (b.transitions_from_states[0].size() == production_doors);
+    };
+    for (bool prune : {false, true}) {
+        std::string suffix = prune ? " (pruned)" : "";
+        strategies.push_back({"sequential configurations" + suffix, [=](board& b, size_t, const board_analysis& analysis) {
+            configuration_pruning pruning{analysis};
+            size_t attempts = sequential_configuration_search<production_doors>(is_wrong(b), false,
+                                                                                prune ? &pruning : nullptr);
+            return navigation_result{attempts, (attempts != 0) ? Solved : NoDoorLeft, {}, pruning.pruned};
+        }, is_production_board, false, prune});
+        strategies.push_back({"random configurations" + suffix, [=](board& b, size_t seed, const board_analysis& analysis) {
+            philox_generator generator_s1{seed, 0}, generator_s2{seed, 1}, generator_s3{seed, 2};
+            configuration_pruning pruning{analysis};
+            size_t attempts = random_configuration_search<production_doors>(generator_s1, generator_s2, generator_s3,
+                                                                             is_wrong(b), false,
+                                                                             prune ? &pruning : nullptr);
+            return navigation_result{attempts, (attempts != 0) ? Solved : NoDoorLeft, {}, pruning.pruned};
+        }, is_production_board, false, prune});
+    }
+    return strategies;
+}
+
+struct strategy_summary {
+    std::string name;
+    trial_statistics attempts;          // Of the solved boards
+    trial_statistics excess;            // Attempts beyond the best case, of the solved boards
+    trial_statistics pruned;            // Skipped without attempting them, of the solved boards of a pruning strategy
+    std::array<size_t, 4> unsolved{};   // By reason
+    size_t skipped = 0;                 // Boards not accepted by the strategy
+    size_t hopeless = 0;                // Unsolvable boards, which are never run
+    double elapsed_seconds = 0.0;
+
+    double throughput() const {
+        return (double)(attempts.count + unsolvedCount()) / elapsed_seconds;
+    }
+
+    size_t unsolvedCount() const {
+        return unsolved[NoDoorLeft] + unsolved[AttemptsExhausted] + unsolved[LoopDetected];
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const strategy_summary &summary) {
+        const trial_statistics& stats = summary.attempts;
+        os << std::left << std::setw(40) << summary.name << std::right
+           << " solved: " << std::setw(6) << stats.count << " unsolved: " << std::setw(6) << summary.unsolvedCount()
+           << " (loops: " << std::setw(6) << summary.unsolved[LoopDetected] << ")";
+        if (summary.skipped > 0)
+            os << " skipped: " << summary.skipped;
+        if (summary.hopeless > 0)
+            os << " hopeless: " << summary.hopeless;
+        if (stats.count > 0)
+            os << " attempts: mean " << stats.mean << " median " << stats.quantile(0.5) << " 95th "
+               << stats.quantile(0.95) << " max " << stats.max_val;
+        if (summary.excess.count > 0)
+            os << " beyond best case: " << summary.excess.mean;
+        if (summary.pruned.count > 0)
+            os << " pruned: mean " << summary.pruned.mean;
+        os << " trials/sec: " << summary.throughput();
+        return os;
+    }
+};
+
+/**
+ * Runs each strategy over the same boards, streamed in batches and distributed among the threads. Each board is run
+ * with the seed of its index, and the statistics are collected in the order of the boards, so that they do not
+ * depend on the threads. The boards are analysed beforehand, so that the unsolvable ones are never run, and the
+ * analysis is given to the strategies for pruning their doors.
+ */
+std::vector<strategy_summary> compare_strategies(const std::vector<door_strategy>& strategies,
+                                                 const board_population& population,
+                                                 size_t nThreads = std::max(1U, std::thread::hardware_concurrency())) {
+    scoped_timer timer{"compare_strategies"};
+    std::vector<strategy_summary> summaries(strategies.size());
+    for (size_t s = 0; s<strategies.size(); s++)
+        summaries[s].name = strategies[s].name;
+
+    board_stream stream{population};
+    std::vector<navigation_result> results;
+    std::vector<size_t> best_case;      // Attempts of the best case of each board, if solvable
+    std::vector<board_analysis> analyses;   // Of each board, reusing their memory across the batches
+    for (std::span<board> boards = stream.next(nThreads); !boards.empty(); boards = stream.next(nThreads)) {
+        size_t first_index = stream.next_index - boards.size();
+        results.resize(boards.size());
+        best_case.resize(boards.size());
+        if (analyses.size() < boards.size())
+            analyses.resize(boards.size());
+        {
+            scoped_timer analysis_timer{"board analysis", "harness"};
+            std::atomic<size_t> next{0};
+            auto parallel_for = [&] {
+                for (size_t i = next++; i<boards.size(); i = next++) {
+                    analyse_board(boards[i], analyses[i]);
+                    best_case[i] = analyses[i].shortestPath(boards[i].end_state);
+                }
+            };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t<nThreads; t++)
+                threads.emplace_back(parallel_for);
+            parallel_for();
+            for (std::thread& t : threads)
+                t.join();
+        }
+        for (size_t s = 0; s<strategies.size(); s++) {
+            const door_strategy& strategy = strategies[s];
+            auto start = std::chrono::steady_clock::now();
+            std::atomic<size_t> next{0};
+            auto parallel_for = [&] {
+                scoped_timer strategy_timer{"strategy", "harness"};
+                board copy{0, 0};       // Reusing its memory across the boards
+                for (size_t i = next++; i<boards.size(); i = next++) {
+                    if ((best_case[i] == board_analysis::unreachable) ||
+                        (strategy.accepts && (!strategy.accepts(boards[i])))) {
+                        results[i] = {0, NoDoorLeft, {}};
+                        continue;
+                    }
+                    copy = boards[i];
+                    results[i] = strategy.run(copy, population.seed + first_index + i, analyses[i]);
+                }
+            };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t<nThreads; t++)
+                threads.emplace_back(parallel_for);
+            parallel_for();
+            for (std::thread& t : threads)
+                t.join();
+
+            strategy_summary& summary = summaries[s];
+            summary.elapsed_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (size_t i = 0; i<boards.size(); i++) {
+                if (best_case[i] == board_analysis::unreachable)
+                    summary.hopeless++;
+                else if (strategy.accepts && (!strategy.accepts(boards[i])))
+                    summary.skipped++;
+                else if (results[i].solved()) {
+                    summary.attempts.add(results[i].attempts);
+                    if (strategy.counts_doors)
+                        summary.excess.add(results[i].attempts - best_case[i]);
+                    if (strategy.prunes)
+                        summary.pruned.add(results[i].pruned);
+                } else
+                    summary.unsolved[results[i].reason]++;
+            }
+        }
+    }
+    return summaries;
 }
 
 int main(void) {
+    trace_recorder::global().start("probability");
+    first_run_static();
     double sum = 0;
     double max = 10000;
     ssize_t max_val = -1;
     size_t min_val = std::numeric_limits<size_t>::max();
+    constexpr auto production_board = second_scenario_board<production_states, production_doors>();
     for (size_t i = 0; i<(size_t)max; i++) {
-        size_t val = third_run_random(i, false);
+        size_t val = third_run_random(production_board, i, false);
         min_val = std::min(val, min_val);
         max_val = std::max((ssize_t)val, max_val);
         sum += (double)val;
@@ -378,4 +1407,76 @@ int main(void) {
     std::cout << "MIN = " << min_val << std::endl;
     std::cout << "MAX = " << max_val << std::endl;
     std::cout << "Average = " << (sum/max) << std::endl;
+
+    // With a counter-based generator, the same trials provide the same results however they are split among threads
+    size_t nThreads = std::max(1U, std::thread::hardware_concurrency());
+    std::vector<std::array<size_t, 3>> partial(nThreads, {std::numeric_limits<size_t>::max(), 0, 0});
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t<nThreads; t++) {
+        threads.emplace_back([&partial, &production_board, max, nThreads, t] {
+            size_t begin = ((size_t)max * t) / nThreads, end = ((size_t)max * (t+1)) / nThreads;
+            for (size_t i = begin; i<end; i++) {
+                size_t val = third_run_random<philox_generator>(production_board, i, false);
+                partial[t][0] = std::min(partial[t][0], val);
+                partial[t][1] = std::max(partial[t][1], val);
+                partial[t][2] += val;
+            }
+        });
+    }
+    for (std::thread& t : threads)
+        t.join();
+    std::array<size_t, 3> total{std::numeric_limits<size_t>::max(), 0, 0};
+    for (const auto& cp : partial) {
+        total[0] = std::min(total[0], cp[0]);
+        total[1] = std::max(total[1], cp[1]);
+        total[2] += cp[2];
+    }
+    std::cout << "Counter-based MIN = " << total[0] << std::endl;
+    std::cout << "Counter-based MAX = " << total[1] << std::endl;
+    std::cout << "Counter-based Average = " << (((double)total[2])/max) << std::endl;
+
+    // Only running the trials needed to know the average attempts within 1%
+    stopping_criteria criteria;
+    criteria.relative_error = 0.01;
+    criteria.budget = std::chrono::seconds{5};
+    std::cout << adaptive_simulation([&production_board](size_t i) {
+        return third_run_random<philox_generator>(production_board, i, false);
+    }, criteria) << std::endl;
+
+    // Choosing the strategy over random boards, with and without back edges
+    board_population population;
+#ifndef NDEBUG
+    {
+        // The boards must survive their binary representation
+        std::stringstream file;
+        board_writer writer{file, population.states, population.doors};
+        for (size_t i = 0; i<100; i++)
+            writer.write(population.generate(i));
+        board_reader reader{file};
+        board b{0, 0};
+        for (size_t i = 0; i<100; i++) {
+            bool was_read = reader.read(b);
+            assert(was_read);
+            board expected = population.generate(i);
+            for (size_t state = 0; state<b.total_states; state++)
+                for (size_t j = 0; j<b.transitions_from_states[state].size(); j++) {
+                    const door& d = b.transitions_from_states[state][j];
+                    const door& e = expected.transitions_from_states[state][j];
+                    assert((d.bricked == e.bricked) && (d.wrong_door == e.wrong_door) &&
+                           (d.reachable_state == e.reachable_state));
+                }
+        }
+        assert(!reader.read(b));
+    }
+#endif
+    for (const strategy_summary& summary : compare_strategies(door_strategies(), population))
+        std::cout << summary << std::endl;
+    population.back_edge_probability = 0.1;
+    std::cout << "With back edges:" << std::endl;
+    for (const strategy_summary& summary : compare_strategies(door_strategies(), population))
+        std::cout << summary << std::endl;
+    population.solvable = false;
+    std::cout << "Without solvability guarantees:" << std::endl;
+    for (const strategy_summary& summary : compare_strategies(door_strategies(), population))
+        std::cout << summary << std::endl;
 }
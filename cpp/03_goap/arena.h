@@ -0,0 +1,155 @@
+//
+// Memory resources shared by the state-space builders
+//
+
+#ifndef GOAP_ARENA_H
+#define GOAP_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+/**
+ * How the containers of a graph obtain their memory
+ */
+enum AllocationMode {
+    DefaultAllocation = 0,  // Each node is allocated and freed through new/delete
+    PoolAllocation = 1,     // Nodes are recycled through per-size pools, released when the graph dies
+    ArenaAllocation = 2     // Nodes are never freed individually, and all the memory is released when the graph dies
+};
+
+/**
+ * Memory resource counting the bytes and the blocks that are allocated through it. If no upstream resource is
+ * given, memory comes from the global operator new, which (differently from std::pmr::new_delete_resource) only
+ * goes through the aligned overloads when strictly needed.
+ */
+struct counting_resource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* upstream;
+    size_t bytes_in_use = 0;
+    size_t blocks_in_use = 0;
+    size_t total_bytes = 0;
+    size_t total_blocks = 0;
+    size_t peak_bytes = 0;
+
+    explicit counting_resource(std::pmr::memory_resource* upstream) : upstream{upstream} {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* ptr;
+        if (upstream)
+            ptr = upstream->allocate(bytes, alignment);
+        else if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            ptr = ::operator new(bytes);
+        else
+            ptr = ::operator new(bytes, std::align_val_t{alignment});
+        bytes_in_use += bytes;
+        blocks_in_use++;
+        total_bytes += bytes;
+        total_blocks++;
+        if (bytes_in_use > peak_bytes)
+            peak_bytes = bytes_in_use;
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        if (upstream)
+            upstream->deallocate(ptr, bytes, alignment);
+        else if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            ::operator delete(ptr, bytes);
+        else
+            ::operator delete(ptr, bytes, std::align_val_t{alignment});
+        bytes_in_use -= bytes;
+        blocks_in_use--;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct allocation_stats {
+    AllocationMode mode;
+    size_t requested_bytes;     // Requested by the containers, and not yet given back
+    size_t requested_blocks;
+    size_t total_requested_bytes;
+    size_t total_requested_blocks;
+    size_t reserved_bytes;      // Obtained from the system, and not yet given back
+    size_t reserved_blocks;
+    size_t peak_reserved_bytes;
+
+    friend std::ostream &operator<<(std::ostream &os, const allocation_stats &stats) {
+        os << "mode: " << stats.mode << " requested: " << stats.requested_bytes << " bytes in "
+           << stats.requested_blocks << " blocks (overall " << stats.total_requested_bytes << " bytes in "
+           << stats.total_requested_blocks << " blocks) reserved: " << stats.reserved_bytes << " bytes in "
+           << stats.reserved_blocks << " blocks (peak " << stats.peak_reserved_bytes << " bytes)";
+        return os;
+    }
+};
+
+/**
+ * Memory shared by all the containers of a graph, which are all freed together when the graph dies. The arena
+ * cannot be moved, as the containers refer to its address: graphs hold it through a shared pointer.
+ */
+struct graph_arena {
+    AllocationMode mode;
+    counting_resource system;                               // Memory obtained from the global new/delete
+    std::unique_ptr<std::pmr::memory_resource> strategy;    // Pool or monotonic buffer, if any
+    counting_resource requests;                             // Memory requested by the containers
+
+    explicit graph_arena(AllocationMode mode = AllocationMode::DefaultAllocation,
+                         size_t initial_arena_size = 1 << 20) :
+            mode{mode},
+            system{nullptr},
+            strategy{make_strategy(mode, initial_arena_size, &system)},
+            requests{strategy ? strategy.get() : &system} {}
+    graph_arena(const graph_arena& ) = delete;
+    graph_arena(graph_arena&& ) = delete;
+    graph_arena& operator=(const graph_arena& ) = delete;
+    graph_arena& operator=(graph_arena&& ) = delete;
+
+    std::pmr::memory_resource* resource() {
+        return &requests;
+    }
+
+    allocation_stats stats() const {
+        return {mode,
+                requests.bytes_in_use, requests.blocks_in_use, requests.total_bytes, requests.total_blocks,
+                system.bytes_in_use, system.blocks_in_use, system.peak_bytes};
+    }
+
+private:
+    static std::unique_ptr<std::pmr::memory_resource> make_strategy(AllocationMode mode,
+                                                                    size_t initial_arena_size,
+                                                                    std::pmr::memory_resource* upstream) {
+        switch (mode) {
+            case PoolAllocation:
+                return std::make_unique<std::pmr::unsynchronized_pool_resource>(upstream);
+            case ArenaAllocation:
+                return std::make_unique<std::pmr::monotonic_buffer_resource>(initial_arena_size, upstream);
+            default:
+                return nullptr;
+        }
+    }
+};
+
+/**
+ * Assigns source to target by rebuilding target in place, for the types whose pmr containers draw from their own
+ * arena: such containers never change their memory resource when assigned, and cannot be swapped with containers
+ * using another resource. As moving does not throw, target is never left destroyed; copies are to be completed
+ * before calling this, so that a failing copy leaves target untouched.
+ */
+template <typename T>
+T& rebuild_in_place(T& target, T&& source) noexcept {
+    static_assert(std::is_nothrow_move_constructible_v<T>, "The target would be left destroyed if moving threw");
+    if (&target != &source) {
+        std::destroy_at(&target);
+        std::construct_at(&target, std::move(source));
+    }
+    return target;
+}
+
+#endif //GOAP_ARENA_H
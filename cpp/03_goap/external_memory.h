@@ -0,0 +1,196 @@
+//
+// Sorted runs on disk, for detecting the duplicate states of a search without keeping them all in memory
+//
+
+#ifndef GOAP_EXTERNAL_MEMORY_H
+#define GOAP_EXTERNAL_MEMORY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Set of hashes answering whether an element might have been inserted: a negative answer is always right, while a
+ * positive one might be wrong
+ */
+struct bloom_filter {
+    std::vector<uint64_t> bits;
+    size_t hashes;
+
+    bloom_filter(size_t nBits = 1 << 20, size_t hashes = 4) : bits((std::max((size_t)64, nBits) + 63) / 64, 0),
+                                                               hashes{hashes} {}
+    bloom_filter(const bloom_filter& ) = default;
+    bloom_filter(bloom_filter&& ) = default;
+    bloom_filter& operator=(const bloom_filter& ) = default;
+    bloom_filter& operator=(bloom_filter&& ) = default;
+
+    /**
+     * @return Whether the hash might have been inserted before
+     */
+    bool insert(size_t hash) {
+        bool found = true;
+        forEachBit(hash, [&found, this](size_t bit) {
+            uint64_t mask = ((uint64_t)1) << (bit % 64);
+            found = found && (bits[bit / 64] & mask);
+            bits[bit / 64] |= mask;
+        });
+        return found;
+    }
+
+    bool mayContain(size_t hash) const {
+        bool found = true;
+        forEachBit(hash, [&found, this](size_t bit) {
+            found = found && (bits[bit / 64] & (((uint64_t)1) << (bit % 64)));
+        });
+        return found;
+    }
+
+private:
+    // Double hashing, with the second hash derived from the first one by a 64 bit mixer
+    template <typename F>
+    void forEachBit(size_t hash, F&& f) const {
+        uint64_t h1 = hash;
+        uint64_t h2 = hash * 0x9E3779B97F4A7C15ULL;
+        h2 ^= h2 >> 31;
+        h2 |= 1;
+        size_t N = bits.size() * 64;
+        for (size_t i = 0; i<hashes; i++)
+            f((size_t)((h1 + i * h2) % N));
+    }
+};
+
+/**
+ * Element of a sorted run: the key identifies the element and is compared bytewise, while the payload distinguishes
+ * the copies of the same element
+ */
+template <typename Payload>
+struct run_record {
+    static_assert(std::is_trivially_copyable_v<Payload>, "The payload is written as it is");
+
+    std::string key;
+    Payload payload;
+};
+
+/**
+ * Sorts the records by key, and only keeps the preferred record of each key
+ *
+ * @param prefer    Whether the first payload is preferred over the second one
+ * @return  Number of records being discarded
+ */
+template <typename Payload, typename Prefer>
+size_t sort_unique(std::vector<run_record<Payload>>& records, Prefer&& prefer) {
+    std::sort(records.begin(), records.end(), [&prefer](const run_record<Payload>& lhs, const run_record<Payload>& rhs) {
+        int cmp = lhs.key.compare(rhs.key);
+        return (cmp < 0) || ((cmp == 0) && prefer(lhs.payload, rhs.payload));
+    });
+    auto last = std::unique(records.begin(), records.end(), [](const run_record<Payload>& lhs, const run_record<Payload>& rhs) {
+        return lhs.key == rhs.key;
+    });
+    size_t discarded = records.end() - last;
+    records.erase(last, records.end());
+    return discarded;
+}
+
+/**
+ * Writes records to a file, one after the other
+ */
+template <typename Payload>
+struct run_writer {
+    std::ofstream out;
+    size_t bytes = 0;
+
+    explicit run_writer(const std::string& path) : out{path, std::ios::binary} {}
+
+    void write(const run_record<Payload>& record) {
+        uint32_t length = (uint32_t)record.key.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(record.key.data(), length);
+        out.write(reinterpret_cast<const char*>(&record.payload), sizeof(Payload));
+        bytes += sizeof(length) + length + sizeof(Payload);
+    }
+};
+
+/**
+ * Reads the records of a file, one after the other
+ */
+template <typename Payload>
+struct run_reader {
+    std::ifstream in;
+    run_record<Payload> current;
+
+    explicit run_reader(const std::string& path) : in{path, std::ios::binary} {}
+
+    /**
+     * @return Whether a further record was read into current
+     */
+    bool next() {
+        uint32_t length;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)))
+            return false;
+        current.key.resize(length);
+        in.read(current.key.data(), length);
+        in.read(reinterpret_cast<char*>(&current.payload), sizeof(Payload));
+        return (bool)in;
+    }
+};
+
+/**
+ * @return  All the records of a file, which is expected to fit in memory
+ */
+template <typename Payload>
+std::vector<run_record<Payload>> read_run(const std::string& path) {
+    std::vector<run_record<Payload>> records;
+    run_reader<Payload> reader{path};
+    while (reader.next())
+        records.emplace_back(std::move(reader.current));
+    return records;
+}
+
+/**
+ * Reads sorted runs at the same time, calling emit once per key with its preferred record
+ *
+ * @param paths     Runs, each sorted by key and without duplicates
+ * @param prefer    Whether the first payload is preferred over the second one
+ * @param emit      Called with each preferred record and the run containing it, by increasing key
+ * @return  Number of records being discarded
+ */
+template <typename Payload, typename Prefer, typename Emit>
+size_t merge_runs(const std::vector<std::string>& paths, Prefer&& prefer, Emit&& emit) {
+    std::vector<run_reader<Payload>> readers;
+    readers.reserve(paths.size());
+    for (const std::string& path : paths)
+        readers.emplace_back(path);
+    auto greater = [&readers, &prefer](size_t lhs, size_t rhs) {
+        int cmp = readers[lhs].current.key.compare(readers[rhs].current.key);
+        return (cmp > 0) || ((cmp == 0) && prefer(readers[rhs].current.payload, readers[lhs].current.payload));
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap{greater};
+    for (size_t i = 0; i<readers.size(); i++)
+        if (readers[i].next())
+            heap.push(i);
+    size_t discarded = 0;
+    std::string lastKey;
+    bool hasLast = false;
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        // The preferred copy of a key comes first
+        if (hasLast && (readers[i].current.key == lastKey)) {
+            discarded++;
+        } else {
+            emit(i, readers[i].current);
+            lastKey = readers[i].current.key;
+            hasLast = true;
+        }
+        if (readers[i].next())
+            heap.push(i);
+    }
+    return discarded;
+}
+
+#endif //GOAP_EXTERNAL_MEMORY_H
@@ -0,0 +1,54 @@
+//
+// Counters and progress reports of the state-space explorations, enabled at compile time
+//
+
+#ifndef GOAP_INSTRUMENTATION_H
+#define GOAP_INSTRUMENTATION_H
+
+#include <chrono>
+#include <cstddef>
+
+/**
+ * When GOAP_INSTRUMENTATION is not defined, the instrumented code is guarded by if constexpr and generates no code.
+ * Outside of templates the discarded branches are still compiled, so they must stay valid either way.
+ */
+#ifdef GOAP_INSTRUMENTATION
+constexpr bool instrumentation_enabled = true;
+#else
+constexpr bool instrumentation_enabled = false;
+#endif
+
+/**
+ * Tells when a progress report is due. The clock is only read once every checkEvery calls, so that it can be asked
+ * at each step of the exploration.
+ */
+struct progress_timer {
+    std::chrono::steady_clock::duration period;
+    size_t checkEvery;
+    size_t calls = 0;
+    std::chrono::steady_clock::time_point start, last;
+
+    explicit progress_timer(std::chrono::steady_clock::duration period = std::chrono::seconds{1},
+                            size_t checkEvery = 4096) :
+            period{period}, checkEvery{checkEvery},
+            start{std::chrono::steady_clock::now()}, last{start} {}
+
+    void restart() {
+        calls = 0;
+        start = last = std::chrono::steady_clock::now();
+    }
+
+    bool isDue() {
+        if ((++calls % checkEvery) != 0) return false;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last < period) return false;
+        last = now;
+        return true;
+    }
+
+    double elapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif //GOAP_INSTRUMENTATION_H
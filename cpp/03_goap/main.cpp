@@ -1,16 +1,20 @@
 #include <iostream>
+#include <algorithm>
 
 #include <yaucl/hashing/hash_combine.h>
 #include <yaucl/hashing/pair_hash.h>
 #include <yaucl/hashing/uset_hash.h>
 
+template <typename K, typename H, typename E, typename A>
+std::ostream& operator<< (std::ostream& out, const std::unordered_set<K, H, E, A>& v);
+
 template <typename K, typename V>
 std::ostream& operator<< (std::ostream& out, const std::pair<K, V>& v) {
     return out << "«" << v.first << ", " << v.second << "»";
 }
 
-template <typename K>
-std::ostream& operator<< (std::ostream& out, const std::unordered_set<K>& v) {
+template <typename K, typename H, typename E, typename A>
+std::ostream& operator<< (std::ostream& out, const std::unordered_set<K, H, E, A>& v) {
     out << "{";
     auto it = v.begin();
     while (it != v.end()) {
@@ -57,31 +61,60 @@ bool solvability_test(const std::unordered_set<T>& init,
 }
 
 #include <cassert>
-using state = std::unordered_set<std::string>;
-using rule = std::pair<state, std::string>;
+#include "symbol_table.h"
+
+// Facts are interned, so that states are sets of integers
+using state = std::unordered_set<symbol>;
+using rule = std::pair<state, symbol>;
 
 void preliminary_test() {
-    assert(solvability_test<std::string>({"A"}, {"A"}, {}));
-    assert(!solvability_test<std::string>({"A"}, {"B"}, {}));
-    assert(!solvability_test<std::string>({"A"}, {"B"}, {{{"C"}, "D"}}));
-    assert(solvability_test<std::string>({"A"}, {"B"}, {{{"A"}, "B"}}));
+    assert(solvability_test<symbol>({"A"}, {"A"}, {}));
+    assert(!solvability_test<symbol>({"A"}, {"B"}, {}));
+    assert(!solvability_test<symbol>({"A"}, {"B"}, {{{"C"}, "D"}}));
+    assert(solvability_test<symbol>({"A"}, {"B"}, {{{"A"}, "B"}}));
 
 }
 
 #include <unordered_map>
 #include <vector>
-
+#include <memory_resource>
+#include "arena.h"
+#include "trace.h"
+
+/**
+ * The nodes of the graph containers come from the graph arena, while the states themselves are still plain
+ * unordered sets of symbols allocated on the heap.
+ */
 struct stateful_graph {
-    std::unordered_map<state, std::unordered_map<state, std::unordered_set<rule>>> adjacency_graph;
-    std::unordered_set<state> accepting_states;
+    std::shared_ptr<graph_arena> arena;     // Declared first, so that it outlives the containers using it
+    std::pmr::unordered_map<state, std::pmr::unordered_map<state, std::pmr::unordered_set<rule>>> adjacency_graph;
+    std::pmr::unordered_set<state> accepting_states;
     state initial_state;
     std::vector<std::string> errors;
 
-    stateful_graph() = default;
-    stateful_graph(const stateful_graph& ) = default;
+    stateful_graph(AllocationMode mode = AllocationMode::DefaultAllocation) :
+            arena{std::make_shared<graph_arena>(mode)},
+            adjacency_graph{arena->resource()},
+            accepting_states{arena->resource()} {}
+    // Copies share the arena of the original graph
+    stateful_graph(const stateful_graph& x) :
+            arena{x.arena},
+            adjacency_graph{x.adjacency_graph, arena->resource()},
+            accepting_states{x.accepting_states, arena->resource()},
+            initial_state{x.initial_state},
+            errors{x.errors} {}
     stateful_graph(stateful_graph&& ) = default;
-    stateful_graph& operator=(const stateful_graph& ) = default;
-    stateful_graph& operator=(stateful_graph&& ) = default;
+    // Like a copy, the assigned graph shares the arena of x, and it is replaced only once the copy is complete
+    stateful_graph& operator=(const stateful_graph& x) {
+        return rebuild_in_place(*this, stateful_graph{x});
+    }
+    stateful_graph& operator=(stateful_graph&& x) noexcept {
+        return rebuild_in_place(*this, std::move(x));
+    }
+
+    allocation_stats memoryStats() const {
+        return arena->stats();
+    }
 
     friend std::ostream &operator<<(std::ostream &os, const stateful_graph &graph) {
         for (const auto& cpM : graph.adjacency_graph) {
@@ -97,6 +130,7 @@ struct stateful_graph {
     }
 
     void dot(std::ostream &os) const {
+        scoped_timer timer{"dot"};
         os << "digraph finite_state_machine {\n"
               "    rankdir=LR;\n"
               "    size=\"8,5\"\n";
@@ -147,13 +181,14 @@ struct GenerateBacktrackStates {
     void generate_graphs(const state& Goal,
                          const state& Init,
                          const std::unordered_set<rule>& Rules) {
+        scoped_timer timer{"generate_graphs"};
         graphs.emplace_back();
         if (Goal.size() == 1) {
             DFSGenerateBacktrackStates(0, *Goal.begin(), Init, Rules);
         } else {
             graphs[0].initial_state = Goal;
             graphs[0].adjacency_graph[Goal] = {};
-            for (const std::string& x : Goal) {
+            for (const symbol& x : Goal) {
                 auto S2 = DFSGenerateBacktrackStates(0, x, Init, Rules);
                 std::stringstream ss ;
                 ss << "Error on expanding for: " << x << " over precondition = " << x;
@@ -172,7 +207,7 @@ struct GenerateBacktrackStates {
 
 private:
     std::pair<state, std::vector<size_t>> DFSGenerateBacktrackStates(size_t idG,
-                                     const std::string& s,
+                                     const symbol& s,
                                      const state& Init,
                                      const std::unordered_set<rule>& Rules) {
         state S = {s};
@@ -189,7 +224,7 @@ private:
                     if (cp.second == s) {
                         countFoundAlsoPartial++;
                         if (countFoundAlsoPartial == 1) {
-                            for (const std::string& x : cp.first) {
+                            for (const symbol& x : cp.first) {
                                 auto S2 = DFSGenerateBacktrackStates(idG, x, Init, Rules);
                                 std::stringstream ss;
                                 ss << "Error on applying rule: " << cp << " over precondition = " << x << std::endl;
@@ -206,7 +241,7 @@ private:
                             size_t currSize = graphs.size();
                             resulting_graphs.emplace_back(currSize);
                             graphs.emplace_back(copyGraph);
-                            for (const std::string& x : cp.first) {
+                            for (const symbol& x : cp.first) {
                                 auto S2 = DFSGenerateBacktrackStates(currSize, x, Init, Rules);
                                 graphs[currSize].adjacency_graph[S][S2.first].insert(cp);
                                 std::stringstream ss;
@@ -236,26 +271,483 @@ private:
     }
 };
 
+#include <cstdint>
+#include <optional>
+#include <yaucl/hashing/vector_hash.h>
+
+using fact_bitset = std::vector<uint64_t>;
+
+/**
+ * Facts interned as consecutive indices, so that the fact sets can be represented as bitsets
+ */
+struct fact_table {
+    std::unordered_map<symbol, size_t> ids;
+    std::vector<symbol> facts;
+
+    size_t intern(const symbol& fact) {
+        auto it = ids.find(fact);
+        if (it != ids.end()) return it->second;
+        ids[fact] = facts.size();
+        facts.emplace_back(fact);
+        return facts.size()-1;
+    }
+
+    size_t words() const {
+        return (facts.size() + 63) / 64;
+    }
+
+    fact_bitset encode(const state& S) const {
+        fact_bitset result(words(), 0);
+        for (const symbol& fact : S)
+            set(result, ids.at(fact));
+        return result;
+    }
+
+    static void set(fact_bitset& S, size_t fact) {
+        S[fact / 64] |= ((uint64_t)1) << (fact % 64);
+    }
+    static void reset(fact_bitset& S, size_t fact) {
+        S[fact / 64] &= ~(((uint64_t)1) << (fact % 64));
+    }
+    static bool test(const fact_bitset& S, size_t fact) {
+        return (S[fact / 64] >> (fact % 64)) & 1;
+    }
+};
+
+bool isSubsetOf(const fact_bitset& subset, const fact_bitset& supset) {
+    for (size_t i = 0, N = subset.size(); i<N; i++)
+        if (subset[i] & ~supset[i])
+            return false;
+    return true;
+}
+
+/**
+ * Fact sets met by a search, each of which is associated to a unique id
+ */
+struct interned_bitsets {
+    static constexpr size_t NoParent = (size_t)-1;
+
+    std::unordered_map<fact_bitset, size_t> ids;
+    std::vector<fact_bitset> sets;
+    std::vector<std::pair<size_t, size_t>> parent;     // Set and rule from which each set was obtained
+
+    /**
+     * @return The id of S, and whether S was never met before
+     */
+    std::pair<size_t, bool> intern(const fact_bitset& S, size_t parentId, size_t ruleId) {
+        auto it = ids.find(S);
+        if (it != ids.end()) return {it->second, false};
+        size_t id = sets.size();
+        ids[S] = id;
+        sets.emplace_back(S);
+        parent.emplace_back(parentId, ruleId);
+        return {id, true};
+    }
+};
+
+#include <bit>
+#include <map>
+
+/**
+ * Fact sets indexed by their facts in increasing order, so that a stored set contained in (or containing) a given
+ * one is found by only visiting the branches compatible with it, rather than by comparing it with every stored set
+ */
+struct set_trie {
+    static constexpr size_t NoId = (size_t)-1;
+
+    struct node {
+        std::map<size_t, size_t> children;      // Next fact, and the node reached with it
+        size_t id = NoId;                       // Of the set ending in the node, if any
+    };
+    std::vector<node> nodes{1};
+
+    static std::vector<size_t> factsOf(const fact_bitset& S) {
+        std::vector<size_t> facts;
+        for (size_t i = 0, N = S.size(); i<N; i++)
+            for (uint64_t word = S[i]; word; word &= word-1)
+                facts.emplace_back(i * 64 + std::countr_zero(word));
+        return facts;
+    }
 
+    void insert(const fact_bitset& S, size_t id) {
+        size_t current = 0;
+        for (size_t fact : factsOf(S)) {
+            auto it = nodes[current].children.find(fact);
+            if (it == nodes[current].children.end()) {
+                size_t child = nodes.size();
+                nodes[current].children.emplace(fact, child);
+                nodes.emplace_back();
+                current = child;
+            } else
+                current = it->second;
+        }
+        nodes[current].id = id;
+    }
+
+    /**
+     * @return The id of a stored set contained in S, or NoId
+     */
+    size_t findSubsetOf(const fact_bitset& S) const {
+        std::vector<size_t> stack{0};
+        while (!stack.empty()) {
+            const node& n = nodes[stack.back()];
+            stack.pop_back();
+            if (n.id != NoId) return n.id;
+            for (const auto& [fact, child] : n.children)
+                if (fact_table::test(S, fact))
+                    stack.emplace_back(child);
+        }
+        return NoId;
+    }
+
+    /**
+     * @return The id of a stored set containing S, or NoId
+     */
+    size_t findSupersetOf(const fact_bitset& S) const {
+        std::vector<size_t> facts = factsOf(S);
+        std::vector<std::pair<size_t, size_t>> stack{{0, 0}};      // Node, and how many facts of S it contains
+        while (!stack.empty()) {
+            auto [current, matched] = stack.back();
+            stack.pop_back();
+            if (matched == facts.size()) {
+                // Each node lies on the path of some stored set
+                while ((nodes[current].id == NoId) && (!nodes[current].children.empty()))
+                    current = nodes[current].children.begin()->second;
+                if (nodes[current].id != NoId) return nodes[current].id;
+                continue;
+            }
+            // Facts missing from S can be skipped, until its next fact is met
+            for (const auto& [fact, child] : nodes[current].children) {
+                if (fact > facts[matched]) break;
+                stack.emplace_back(child, matched + (fact == facts[matched]));
+            }
+        }
+        return NoId;
+    }
+};
+
+struct plan_result {
+    bool found = false;
+    std::vector<rule> plan;         // Rules to be applied from the initial state, in order
+    size_t forward_states = 0;      // States reached from the initial state
+    size_t backward_states = 0;     // Regressions of the goal
+
+    friend std::ostream &operator<<(std::ostream &os, const plan_result &result) {
+        os << "found: " << result.found << " forward_states: " << result.forward_states << " backward_states: "
+           << result.backward_states << std::endl;
+        for (const rule& r : result.plan)
+            os << " - " << r << std::endl;
+        return os;
+    }
+};
+
+/**
+ * Looks for a sequence of rules leading from Init to a state containing Goal, by expanding at the same time the
+ * states reachable from Init and the regressions of Goal, i.e. the fact sets from which the goal can be achieved.
+ * The smallest frontier is expanded first, and the search stops as soon as a regression is contained in a
+ * reached state. Both sides are indexed by a set_trie, so that each new set is only matched against the sets of
+ * the opposite side sharing its facts.
+ *
+ * @param Init      Initial state
+ * @param Goal      Facts to be achieved
+ * @param Rules     Rules adding their second component when their first component is satisfied
+ * @return The connecting rule sequence, if any
+ */
+plan_result bidirectional_plan(const state& Init,
+                               const state& Goal,
+                               const std::unordered_set<rule>& Rules) {
+    scoped_timer timer{"bidirectional_plan"};
+    fact_table table;
+    for (const symbol& x : Init) table.intern(x);
+    for (const symbol& x : Goal) table.intern(x);
+    std::vector<rule> rules{Rules.begin(), Rules.end()};
+    for (const rule& r : rules) {
+        for (const symbol& x : r.first) table.intern(x);
+        table.intern(r.second);
+    }
+    std::vector<fact_bitset> preconditions;
+    std::vector<size_t> effects;
+    fact_bitset producible = table.encode(Init);    // Facts that might ever hold
+    for (const rule& r : rules) {
+        preconditions.emplace_back(table.encode(r.first));
+        effects.emplace_back(table.ids.at(r.second));
+        fact_table::set(producible, effects.back());
+    }
+
+    plan_result result;
+    interned_bitsets forward, backward;
+    std::vector<size_t> forwardFrontier{forward.intern(table.encode(Init), interned_bitsets::NoParent, 0).first};
+    std::vector<size_t> backwardFrontier{backward.intern(table.encode(Goal), interned_bitsets::NoParent, 0).first};
+    set_trie forwardIndex, backwardIndex;
+    forwardIndex.insert(forward.sets[0], 0);
+    backwardIndex.insert(backward.sets[0], 0);
+    std::optional<std::pair<size_t, size_t>> meeting;
+    if (isSubsetOf(backward.sets[0], forward.sets[0]))
+        meeting = {0, 0};
+
+    std::vector<size_t> next;
+    while ((!meeting) && (!forwardFrontier.empty()) && (!backwardFrontier.empty())) {
+        next.clear();
+        if (forwardFrontier.size() <= backwardFrontier.size()) {
+            for (size_t src : forwardFrontier) {
+                for (size_t r = 0, N = rules.size(); (r<N) && (!meeting); r++) {
+                    if ((!isSubsetOf(preconditions[r], forward.sets[src])) ||
+                        fact_table::test(forward.sets[src], effects[r]))
+                        continue;
+                    fact_bitset S = forward.sets[src];
+                    fact_table::set(S, effects[r]);
+                    auto cp = forward.intern(S, src, r);
+                    if (!cp.second) continue;
+                    next.emplace_back(cp.first);
+                    forwardIndex.insert(S, cp.first);
+                    size_t b = backwardIndex.findSubsetOf(S);
+                    if (b != set_trie::NoId)
+                        meeting = {cp.first, b};
+                }
+                if (meeting) break;
+            }
+            std::swap(forwardFrontier, next);
+        } else {
+            for (size_t src : backwardFrontier) {
+                for (size_t r = 0, N = rules.size(); (r<N) && (!meeting); r++) {
+                    if (!fact_table::test(backward.sets[src], effects[r]))
+                        continue;   // The rule does not contribute to the goal
+                    fact_bitset R = backward.sets[src];
+                    fact_table::reset(R, effects[r]);
+                    for (size_t i = 0, M = R.size(); i<M; i++)
+                        R[i] |= preconditions[r][i];
+                    if (!isSubsetOf(R, producible))
+                        continue;   // No state will ever contain the regression
+                    auto cp = backward.intern(R, src, r);
+                    if (!cp.second) continue;
+                    next.emplace_back(cp.first);
+                    backwardIndex.insert(R, cp.first);
+                    size_t f = forwardIndex.findSupersetOf(R);
+                    if (f != set_trie::NoId)
+                        meeting = {f, cp.first};
+                }
+                if (meeting) break;
+            }
+            std::swap(backwardFrontier, next);
+        }
+    }
+    result.forward_states = forward.sets.size();
+    result.backward_states = backward.sets.size();
+    if (!meeting) return result;
+
+    // Rules leading to the meeting state, followed by the ones achieving the goal from its regression
+    std::vector<size_t> ruleIds;
+    for (size_t f = meeting->first; forward.parent[f].first != interned_bitsets::NoParent; f = forward.parent[f].first)
+        ruleIds.emplace_back(forward.parent[f].second);
+    std::reverse(ruleIds.begin(), ruleIds.end());
+    for (size_t b = meeting->second; backward.parent[b].first != interned_bitsets::NoParent; b = backward.parent[b].first)
+        ruleIds.emplace_back(backward.parent[b].second);
+
+    // As the state might already contain some of the facts required by the regression, their rules are skipped
+    fact_bitset current = table.encode(Init);
+    for (size_t r : ruleIds) {
+        if (fact_table::test(current, effects[r])) continue;
+        assert(isSubsetOf(preconditions[r], current));
+        fact_table::set(current, effects[r]);
+        result.plan.emplace_back(rules[r]);
+    }
+    assert(isSubsetOf(backward.sets[0], current));
+    result.found = true;
+    return result;
+}
+
+/**
+ * Rule set compiled for computing fixed points in linear time: each rule counts how many of its preconditions are
+ * still missing, and is triggered as soon as the last of them is derived.
+ */
+struct compiled_rules {
+    fact_table table;
+    std::vector<size_t> preconditionCount;
+    std::vector<size_t> effects;
+    std::vector<std::vector<size_t>> watchers;  // Rules having each fact as a precondition
+    std::vector<size_t> unconditioned;          // Rules having no precondition
+
+    explicit compiled_rules(const std::unordered_set<rule>& Rules) {
+        for (const rule& r : Rules) {
+            for (const symbol& x : r.first) table.intern(x);
+            table.intern(r.second);
+        }
+        watchers.resize(table.facts.size());
+        for (const rule& r : Rules) {
+            size_t id = effects.size();
+            effects.emplace_back(table.ids.at(r.second));
+            preconditionCount.emplace_back(r.first.size());
+            for (const symbol& x : r.first)
+                watchers[table.ids.at(x)].emplace_back(id);
+            if (r.first.empty())
+                unconditioned.emplace_back(id);
+        }
+    }
+    compiled_rules(const compiled_rules& ) = default;
+    compiled_rules(compiled_rules&& ) = default;
+    compiled_rules& operator=(const compiled_rules& ) = default;
+    compiled_rules& operator=(compiled_rules&& ) = default;
+
+    /**
+     * @return The bitset of the facts in S, where the facts not occurring in any rule are ignored, as they cannot
+     * trigger any rule
+     */
+    fact_bitset encodeKnown(const state& S) const {
+        fact_bitset result(table.words(), 0);
+        for (const symbol& fact : S) {
+            auto it = table.ids.find(fact);
+            if (it != table.ids.end())
+                fact_table::set(result, it->second);
+        }
+        return result;
+    }
+
+    /**
+     * Computes all the facts derivable from init, as the fixed point of solvability_test
+     *
+     * @param init      Known facts of the initial state
+     * @param missing   Memory reused across the calls, for counting the missing preconditions
+     * @param queue     Memory reused across the calls, for the facts to be propagated
+     */
+    fact_bitset closure(const fact_bitset& init, std::vector<size_t>& missing, std::vector<size_t>& queue) const {
+        fact_bitset result = init;
+        missing = preconditionCount;
+        queue.clear();
+        for (size_t fact = 0, N = table.facts.size(); fact<N; fact++)
+            if (fact_table::test(init, fact))
+                queue.emplace_back(fact);
+        auto derive = [&result, &queue](size_t fact) {
+            if (!fact_table::test(result, fact)) {
+                fact_table::set(result, fact);
+                queue.emplace_back(fact);
+            }
+        };
+        for (size_t r : unconditioned)
+            derive(effects[r]);
+        while (!queue.empty()) {
+            size_t fact = queue.back();
+            queue.pop_back();
+            for (size_t r : watchers[fact])
+                if (--missing[r] == 0)
+                    derive(effects[r]);
+        }
+        return result;
+    }
+};
+
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/**
+ * Answers many solvability queries over the same rule set. The closures are cached by initial state, so that
+ * queries sharing the same initial state are answered by looking up the closure computed once.
+ */
+struct solvability_service {
+    compiled_rules rules;
+    std::unordered_map<fact_bitset, fact_bitset> closures;
+
+    explicit solvability_service(const std::unordered_set<rule>& Rules) : rules{Rules} {}
+
+    /**
+     * @param queries   Pairs of initial states and goals
+     * @param nThreads  Threads computing the closures and answering the queries
+     * @return  Whether each goal can be achieved from its initial state, as in solvability_test
+     */
+    std::vector<bool> solve(const std::vector<std::pair<state, state>>& queries,
+                            size_t nThreads = std::thread::hardware_concurrency()) {
+        scoped_timer timer{"solvability_service::solve"};
+        nThreads = std::max((size_t)1, nThreads);
+        auto parallel_for = [nThreads](size_t N, const std::function<void(size_t, size_t)>& f) {
+            std::atomic<size_t> next{0};
+            auto worker = [&next, &f, N](size_t threadId) {
+                scoped_timer timer{"solve worker"};
+                for (size_t i = next++; i<N; i = next++)
+                    f(threadId, i);
+            };
+            std::vector<std::thread> threads;
+            for (size_t threadId = 1, M = std::min(nThreads, N); threadId<M; threadId++)
+                threads.emplace_back(worker, threadId);
+            worker(0);
+            for (std::thread& t : threads)
+                t.join();
+        };
+
+        // Initial states whose closure was never computed
+        std::vector<fact_bitset> inits(queries.size());
+        parallel_for(queries.size(), [this, &queries, &inits](size_t, size_t i) {
+            inits[i] = rules.encodeKnown(queries[i].first);
+        });
+        std::vector<fact_bitset> missingInits;
+        std::unordered_set<fact_bitset> scheduled;
+        for (const fact_bitset& init : inits)
+            if ((!closures.contains(init)) && scheduled.insert(init).second)
+                missingInits.emplace_back(init);
+        std::vector<fact_bitset> missingClosures(missingInits.size());
+        std::vector<std::vector<size_t>> missing(nThreads), queue(nThreads);
+        parallel_for(missingInits.size(), [&](size_t threadId, size_t i) {
+            missingClosures[i] = rules.closure(missingInits[i], missing[threadId], queue[threadId]);
+        });
+        for (size_t i = 0, N = missingInits.size(); i<N; i++)
+            closures.emplace(std::move(missingInits[i]), std::move(missingClosures[i]));
+
+        // Goal facts not occurring in the rules can only be satisfied by the initial state
+        std::vector<char> answers(queries.size());
+        parallel_for(queries.size(), [this, &queries, &inits, &answers](size_t, size_t i) {
+            const fact_bitset& closure = closures.at(inits[i]);
+            bool isSolvable = true;
+            for (const symbol& fact : queries[i].second) {
+                auto it = rules.table.ids.find(fact);
+                isSolvable = (it != rules.table.ids.end()) ? fact_table::test(closure, it->second)
+                                                           : queries[i].first.contains(fact);
+                if (!isSolvable) break;
+            }
+            answers[i] = isSolvable;
+        });
+        return {answers.begin(), answers.end()};
+    }
+};
+
+/**
+ * Chain of doors, each of which opens with the key found behind the previous one, and hides some useless items
+ * that make the number of reachable states grow exponentially
+ *
+ * @param length        Number of doors to be opened
+ * @param distractors   Useless items behind each door
+ */
+void chain_example(size_t length, size_t distractors) {
+    std::unordered_set<rule> rules;
+    for (size_t i = 0; i<length; i++) {
+        std::string key = "Key_" + std::to_string(i), door = "Door_" + std::to_string(i);
+        rules.insert({{key}, door});
+        rules.insert({{door}, "Key_" + std::to_string(i+1)});
+        for (size_t j = 0; j<distractors; j++)
+            rules.insert({{door}, "Item_" + std::to_string(i) + "_" + std::to_string(j)});
+    }
+    auto result = bidirectional_plan({"Key_0"}, {"Door_" + std::to_string(length-1)}, rules);
+    std::cout << "Chain of " << length << " doors: " << result << std::endl;
+}
 
 void example(bool single_path_example = true,
              bool single_path_with_errors = true,
              bool generate_possible_states = false,
-             bool check_solvability = false) {
-    std::string key_a = "Key_A";
-    std::string key_b = "Key_B";
-    std::string key_c = "Key_C";
-    std::string key_d = "Key_D";
-    std::string key_e = "Key_E";
-    std::string key_f = "Key_Finish";
-    std::string key_t = "Key_T";
-    std::string door_a = "Door_A";
-    std::string door_b = "Door_B";
-    std::string door_ce = "Door_CE";
-    std::string door_d1 = "Door_D1";
-    std::string door_d2 = "Door_D2";
-    std::string door_t = "Door_T";
-    std::string door_f = "Door_Finish";
+             bool check_solvability = false,
+             bool bidirectional_search = true,
+             bool batch_solvability = true) {
+    symbol key_a = "Key_A";
+    symbol key_b = "Key_B";
+    symbol key_c = "Key_C";
+    symbol key_d = "Key_D";
+    symbol key_e = "Key_E";
+    symbol key_f = "Key_Finish";
+    symbol key_t = "Key_T";
+    symbol door_a = "Door_A";
+    symbol door_b = "Door_B";
+    symbol door_ce = "Door_CE";
+    symbol door_d1 = "Door_D1";
+    symbol door_d2 = "Door_D2";
+    symbol door_t = "Door_T";
+    symbol door_f = "Door_Finish";
 
     rule r1 = {{key_a}, {door_a}};
     rule r2a = {{door_a}, {key_e}};
@@ -272,14 +764,33 @@ void example(bool single_path_example = true,
     rule r11 = {{door_ce, key_f}, {door_f}};
 
     if (check_solvability) {
-        assert(solvability_test<std::string>({key_a}, {door_f}, {r1, r2a, r2b, r3a, r3b, r4, r5, r6, r7, r8, r9, r10, r11}));
+        assert(solvability_test<symbol>({key_a}, {door_f}, {r1, r2a, r2b, r3a, r3b, r4, r5, r6, r7, r8, r9, r10, r11}));
     }
     if (generate_possible_states) {
         stateful_graph G;
         G.initial_state = {key_a};
+        scoped_timer timer{"DFSGeneratePossibleStates"};
         DFSGeneratePossibleStates(G, G.initial_state, {door_f}, {r1, r2a, r2b, r3a, r3b, r4, r5, r6, r7, r8, r9, r10, r11});
     }
 
+    if (batch_solvability) {
+        // Which door can be opened when starting with a single key
+        solvability_service service{{r1, r2a, r2b, r3a, r3b, r4, r5, r6, r7, r8, r9, r10, r11}};
+        std::vector<std::pair<state, state>> queries;
+        for (const symbol& key : {key_a, key_b, key_c, key_d, key_e, key_f, key_t})
+            for (const symbol& door : {door_a, door_b, door_ce, door_d1, door_d2, door_t, door_f})
+                queries.push_back({{key}, {door}});
+        auto answers = service.solve(queries);
+        std::cout << "Solvable queries:" << std::endl;
+        for (size_t i = 0, N = queries.size(); i<N; i++)
+            if (answers[i])
+                std::cout << " - " << queries[i].first << " => " << queries[i].second << std::endl;
+    }
+    if (bidirectional_search) {
+        auto result = bidirectional_plan({key_a}, {door_f}, {r1, r2a, r2b, r3a, r3b, r4, r5, r6, r7, r8, r9, r10, r11});
+        std::cout << "Plan: " << result << std::endl;
+    }
+
     GenerateBacktrackStates gbs;
 
     if (single_path_example) {
@@ -317,7 +828,9 @@ void example(bool single_path_example = true,
 
 
 int main() {
+    trace_recorder::global().start("goap");
     example();
+    chain_example(12, 2);
 
      return 0;
 }
@@ -19,6 +19,15 @@ double pairDistance(const std::pair<size_t, size_t> &p1,
                      std::pow(((double) p1.second) - ((double) p2.second), 2));
 }
 
+/**
+ * @return  The least number of movements leading from p1 to p2, as the robot cannot move diagonally
+ */
+size_t stepDistance(const std::pair<size_t, size_t> &p1,
+                    const std::pair<size_t, size_t> &p2) {
+    return (std::max(p1.first, p2.first) - std::min(p1.first, p2.first)) +
+           (std::max(p1.second, p2.second) - std::min(p1.second, p2.second));
+}
+
 
 enum Directions {
     N = 3,
@@ -84,6 +93,7 @@ std::pair<bool,
 
 #include <vector>
 #include <ostream>
+#include <algorithm>
 
 template <typename K, typename V>
 std::ostream& operator<< (std::ostream& out, const std::pair<K, V>& v) {
@@ -92,8 +102,8 @@ std::ostream& operator<< (std::ostream& out, const std::pair<K, V>& v) {
 
 #include <unordered_set>
 
-template <typename K>
-std::ostream& operator<< (std::ostream& out, const std::unordered_set<K>& v) {
+template <typename K, typename H, typename E, typename A>
+std::ostream& operator<< (std::ostream& out, const std::unordered_set<K, H, E, A>& v) {
     out << "{";
     auto it = v.begin();
     while (it != v.end()) {
@@ -105,8 +115,8 @@ std::ostream& operator<< (std::ostream& out, const std::unordered_set<K>& v) {
     return out << "}";
 }
 
-template <typename K>
-std::ostream& operator<< (std::ostream& out, const std::vector<K>& v) {
+template <typename K, typename A>
+std::ostream& operator<< (std::ostream& out, const std::vector<K, A>& v) {
     out << "[[";
     auto it = v.begin();
     while (it != v.end()) {
@@ -140,6 +150,104 @@ std::vector<std::pair<Directions, std::pair<size_t, size_t>>> rankDirections(con
     return cp;
 }
 
+#include <array>
+
+/**
+ * Movements allowed from a cell, after excluding the one leading back to the previous cell
+ */
+struct AllowedMovements {
+    static constexpr size_t MaxDirections = 4;
+    static constexpr size_t NoExclusion = MaxDirections;
+
+    std::array<std::pair<Directions, std::pair<size_t, size_t>>, MaxDirections> cells;
+    size_t size = 0;
+    size_t excluded = NoExclusion;    // Position of the excluded movement among the neighbours of the cell
+
+    bool empty() const { return size == 0; }
+    auto begin() const { return cells.begin(); }
+    auto end() const { return cells.begin() + size; }
+};
+
+/**
+ * Lookup tables for the board geometry, which only depends on the cell coordinates and on the fixed points of
+ * interest. This avoids both allocating and performing floating point operations while expanding the states.
+ */
+struct BoardGeometry {
+    struct Cell {
+        AllowedMovements neighbours;            // All the movements allowed from the cell, in generateDirections order
+        double fillingStationDistance = 0.0;    // Floor of the distance from the filling station
+        double unloadingDistance = 0.0;         // Floor of the distance from the unloading zone
+        size_t fillingStationSteps = 0;         // Least movements leading to the filling station
+        size_t unloadingSteps = 0;              // Least movements leading to the unloading zone
+        // Best ranked movement towards each point of interest, indexed by the excluded neighbour
+        std::array<Directions, AllowedMovements::MaxDirections + 1> towardsFillingStation, towardsUnloading;
+    };
+
+    std::pair<size_t, size_t> boardSize;
+    std::vector<Cell> cells;
+
+    BoardGeometry() : boardSize{0, 0} {}
+    BoardGeometry(const BoardGeometry& ) = default;
+    BoardGeometry(BoardGeometry&& ) = default;
+    BoardGeometry& operator=(const BoardGeometry& ) = default;
+    BoardGeometry& operator=(BoardGeometry&& ) = default;
+
+    void build(const std::pair<size_t, size_t>& size,
+               const std::pair<size_t, size_t>& fillingStationCoordinate,
+               const std::pair<size_t, size_t>& unloadingCoordinate) {
+        boardSize = size;
+        cells.assign(boardSize.first * boardSize.second, {});
+        for (size_t x = 0; x < boardSize.first; x++) {
+            for (size_t y = 0; y < boardSize.second; y++) {
+                std::pair<size_t, size_t> coord{x, y};
+                Cell& cell = cells[index(coord)];
+                auto allowedDirections = generateDirections(coord, boardSize.first, boardSize.second);
+                for (const auto& dir : allowedDirections)
+                    cell.neighbours.cells[cell.neighbours.size++] = dir;
+                cell.fillingStationDistance = std::floor(pairDistance(coord, fillingStationCoordinate));
+                cell.unloadingDistance = std::floor(pairDistance(coord, unloadingCoordinate));
+                cell.fillingStationSteps = stepDistance(coord, fillingStationCoordinate);
+                cell.unloadingSteps = stepDistance(coord, unloadingCoordinate);
+                // Using the very same ranking adopted when no table was available
+                for (size_t excluded = 0; excluded <= AllowedMovements::NoExclusion; excluded++) {
+                    auto candidates = allowedDirections;
+                    if (excluded < candidates.size())
+                        candidates.erase(candidates.begin() + excluded);
+                    if (candidates.empty()) continue;
+                    cell.towardsFillingStation[excluded] = rankDirections(candidates, fillingStationCoordinate).begin()->first;
+                    cell.towardsUnloading[excluded] = rankDirections(candidates, unloadingCoordinate).begin()->first;
+                }
+            }
+        }
+    }
+
+    size_t index(const std::pair<size_t, size_t>& coord) const {
+        return coord.first * boardSize.second + coord.second;
+    }
+
+    const Cell& at(const std::pair<size_t, size_t>& coord) const {
+        return cells[index(coord)];
+    }
+
+    /**
+     * @param coord     Current cell
+     * @param prevCell  Cell from which the robot reached the current one (or the current cell itself)
+     * @return  The movements allowed from coord which do not lead back to prevCell
+     */
+    AllowedMovements allowedMovements(const std::pair<size_t, size_t>& coord,
+                                      const std::pair<size_t, size_t>& prevCell) const {
+        const AllowedMovements& neighbours = at(coord).neighbours;
+        AllowedMovements result;
+        for (size_t i = 0; i < neighbours.size; i++) {
+            if (neighbours.cells[i].second == prevCell)
+                result.excluded = i;
+            else
+                result.cells[result.size++] = neighbours.cells[i];
+        }
+        return result;
+    }
+};
+
 
 enum LoadType {
     OneLog = 2,
@@ -150,17 +258,23 @@ enum LoadType {
 #include <yaucl/hashing/hash_combine.h>
 #include <yaucl/hashing/pair_hash.h>
 #include <yaucl/hashing/vector_hash.h>
+#include <memory_resource>
+#include "arena.h"
+#include "trace.h"
 
 struct EnvironmentStatus {
+    // The status is allocator-aware, so that its vectors are placed in the arena of the graph storing it
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
     double satiety;
     double remaining_time;
     size_t game_progress;
     size_t nActionsPerformed;
     LoadType isLoadedOrEmpty;
     std::pair<size_t, size_t> currentCellCoord;
-    std::vector<size_t> LogCellsContent;
-    std::vector<size_t> StoneCellsContent;
-    std::vector<LoadType> UnloadZoneContent;
+    std::pmr::vector<size_t> LogCellsContent;
+    std::pmr::vector<size_t> StoneCellsContent;
+    std::pmr::vector<LoadType> UnloadZoneContent;
     bool isIgnited;
 
     EnvironmentStatus() : EnvironmentStatus{0, 0} {}
@@ -169,6 +283,18 @@ struct EnvironmentStatus {
                                             currentCellCoord{x, y} {};
     EnvironmentStatus(EnvironmentStatus &&) = default;
     EnvironmentStatus(const EnvironmentStatus &) = default;
+    EnvironmentStatus(const EnvironmentStatus &x, const allocator_type& alloc) :
+            satiety{x.satiety}, remaining_time{x.remaining_time}, game_progress{x.game_progress},
+            nActionsPerformed{x.nActionsPerformed}, isLoadedOrEmpty{x.isLoadedOrEmpty},
+            currentCellCoord{x.currentCellCoord}, LogCellsContent{x.LogCellsContent, alloc},
+            StoneCellsContent{x.StoneCellsContent, alloc}, UnloadZoneContent{x.UnloadZoneContent, alloc},
+            isIgnited{x.isIgnited} {}
+    EnvironmentStatus(EnvironmentStatus &&x, const allocator_type& alloc) :
+            satiety{x.satiety}, remaining_time{x.remaining_time}, game_progress{x.game_progress},
+            nActionsPerformed{x.nActionsPerformed}, isLoadedOrEmpty{x.isLoadedOrEmpty},
+            currentCellCoord{x.currentCellCoord}, LogCellsContent{std::move(x.LogCellsContent), alloc},
+            StoneCellsContent{std::move(x.StoneCellsContent), alloc}, UnloadZoneContent{std::move(x.UnloadZoneContent), alloc},
+            isIgnited{x.isIgnited} {}
     EnvironmentStatus &operator=(EnvironmentStatus &&) = default;
     EnvironmentStatus &operator=(const EnvironmentStatus &) = default;
 
@@ -217,6 +343,15 @@ struct EnvironmentStatus {
     }
 
     bool isGameProgressPositive() const {
+        return isGameProgressPositive(false, LoadType::FuelOrNoop);
+    }
+
+    /**
+     * @param unloads   Whether an additional item is going to be placed in the unloading zone
+     * @param item      Item to be additionally placed
+     * @return  Whether the game progresses after (possibly) placing the item
+     */
+    bool isGameProgressPositive(bool unloads, LoadType item) const {
         size_t countTotalLogs = 0;
         size_t countTotalStones = 0;
         size_t countTotalFuel = 0;
@@ -228,6 +363,14 @@ struct EnvironmentStatus {
             else if (t == LoadType::FuelOrNoop)
                 countTotalFuel++;
         }
+        if (unloads) {
+            if (item == LoadType::OneLog)
+                countTotalLogs++;
+            else if (item == LoadType::OneStone)
+                countTotalStones++;
+            else if (item == LoadType::FuelOrNoop)
+                countTotalFuel++;
+        }
         return (countTotalLogs<=2) && (countTotalStones<=3) && (countTotalFuel<=1);
     }
 
@@ -242,27 +385,213 @@ struct EnvironmentStatus {
 
 };
 
+#include <cstdint>
+
+/**
+ * Hash of a status, made of the hash of its scalar fields plus one term for each element of its vectors. As the
+ * terms are summed, the hash of a successor is obtained from the one of the expanded status by only replacing the
+ * terms of the elements that a rule changes.
+ */
+struct status_hash {
+    enum Contents { LogCells = 1, StoneCells = 2, UnloadZone = 3 };
+
+    static size_t scalars(double satiety, double remaining_time, size_t game_progress, LoadType isLoadedOrEmpty,
+                          const std::pair<size_t, size_t>& currentCellCoord) {
+        return yaucl::hashing::hash_combine(
+                yaucl::hashing::hash_combine(
+                        yaucl::hashing::hash_combine(yaucl::hashing::hash_combine(
+                                yaucl::hashing::hash_combine(31, satiety),
+                                remaining_time), game_progress),
+                        isLoadedOrEmpty),
+                currentCellCoord);
+    }
+
+    /**
+     * @return  Term of the value at a position of one of the vectors, mixed so that the sum of the terms does not
+     *          depend on them linearly
+     */
+    static size_t element(Contents contents, size_t position, size_t value) {
+        uint64_t h = yaucl::hashing::hash_combine(yaucl::hashing::hash_combine((size_t)contents, position), value);
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+        return (size_t)(h ^ (h >> 31));
+    }
+
+    template <typename T, typename A>
+    static size_t contents(Contents contents, const std::vector<T, A>& v) {
+        size_t result = 0;
+        for (size_t i = 0, N = v.size(); i<N; i++)
+            result += element(contents, i, (size_t)v[i]);
+        return result;
+    }
+
+    /**
+     * @return  Sum of the terms of all the elements of the vectors of a status
+     */
+    static size_t contents(const EnvironmentStatus& x) {
+        return contents(LogCells, x.LogCellsContent) + contents(StoneCells, x.StoneCellsContent) +
+               contents(UnloadZone, x.UnloadZoneContent);
+    }
+
+    static size_t of(const EnvironmentStatus& x) {
+        return scalars(x.satiety, x.remaining_time, x.game_progress, x.isLoadedOrEmpty, x.currentCellCoord) +
+               contents(x);
+    }
+};
+
 namespace std {
     template<>
     struct hash<EnvironmentStatus> {
         size_t operator()(const EnvironmentStatus &x) const {
-            return yaucl::hashing::hash_combine(
-                    yaucl::hashing::hash_combine(
-                            yaucl::hashing::hash_combine(
-                                    yaucl::hashing::hash_combine(
-                                            yaucl::hashing::hash_combine(
-                                                    yaucl::hashing::hash_combine(yaucl::hashing::hash_combine(
-                                                            yaucl::hashing::hash_combine(31, x.satiety),
-                                                            x.remaining_time), x.game_progress),
-                                                    x.isLoadedOrEmpty),
-                                            x.currentCellCoord),
-                                    x.LogCellsContent),
-                            x.StoneCellsContent),
-                    x.UnloadZoneContent);
+            return status_hash::of(x);
         }
     };
 }
 
+/**
+ * Change that a rule performs over an EnvironmentStatus. All the scalar fields are stored with the value they have
+ * after the change, so that successors can be obtained by updating in place a copy of the expanded status, and
+ * restored by copying back the fields from the expanded status. This avoids copying the whole status, vectors
+ * included, for every rule being applied.
+ */
+struct StatusDelta {
+    static constexpr size_t NoCell = (size_t)-1;
+
+    double satiety;
+    double remaining_time;
+    size_t game_progress;
+    size_t nActionsPerformed;
+    LoadType isLoadedOrEmpty;
+    std::pair<size_t, size_t> currentCellCoord;
+    bool isIgnited;
+    size_t takenLogCell = NoCell;       // Log cell whose content decreases by one, if any
+    size_t takenStoneCell = NoCell;     // Stone cell whose content decreases by one, if any
+    bool unloads = false;               // Whether unloadedItem is placed in the unloading zone
+    LoadType unloadedItem = LoadType::FuelOrNoop;
+
+    StatusDelta(const EnvironmentStatus& S) : satiety{S.satiety}, remaining_time{S.remaining_time},
+                                              game_progress{S.game_progress}, nActionsPerformed{S.nActionsPerformed},
+                                              isLoadedOrEmpty{S.isLoadedOrEmpty}, currentCellCoord{S.currentCellCoord},
+                                              isIgnited{S.isIgnited} {}
+    StatusDelta(const StatusDelta& ) = default;
+    StatusDelta(StatusDelta&& ) = default;
+    StatusDelta& operator=(const StatusDelta& ) = default;
+    StatusDelta& operator=(StatusDelta&& ) = default;
+
+    /**
+     * @param status    Copy of the status from which the delta was computed, which becomes the successor
+     */
+    void apply(EnvironmentStatus& status) const {
+        status.satiety = satiety;
+        status.remaining_time = remaining_time;
+        status.game_progress = game_progress;
+        status.nActionsPerformed = nActionsPerformed;
+        status.isLoadedOrEmpty = isLoadedOrEmpty;
+        status.currentCellCoord = currentCellCoord;
+        status.isIgnited = isIgnited;
+        if (takenLogCell != NoCell)
+            status.LogCellsContent[takenLogCell]--;
+        if (takenStoneCell != NoCell)
+            status.StoneCellsContent[takenStoneCell]--;
+        if (unloads)
+            status.UnloadZoneContent.emplace_back(unloadedItem);
+    }
+
+    /**
+     * @param status    Successor obtained through apply
+     * @param S         Status from which the delta was computed
+     */
+    void undo(EnvironmentStatus& status, const EnvironmentStatus& S) const {
+        status.satiety = S.satiety;
+        status.remaining_time = S.remaining_time;
+        status.game_progress = S.game_progress;
+        status.nActionsPerformed = S.nActionsPerformed;
+        status.isLoadedOrEmpty = S.isLoadedOrEmpty;
+        status.currentCellCoord = S.currentCellCoord;
+        status.isIgnited = S.isIgnited;
+        if (takenLogCell != NoCell)
+            status.LogCellsContent[takenLogCell]++;
+        if (takenStoneCell != NoCell)
+            status.StoneCellsContent[takenStoneCell]++;
+        if (unloads)
+            status.UnloadZoneContent.pop_back();
+    }
+};
+
+/**
+ * Successor of a status, described by the expanded status and by the change of a rule, so that it can be looked up
+ * in a graph without being built
+ */
+struct status_successor {
+    const EnvironmentStatus& S;
+    const StatusDelta& delta;
+    size_t hash;
+
+    /**
+     * @param contents  status_hash::contents of S, which is shared by all of its successors
+     */
+    status_successor(const EnvironmentStatus& S, const StatusDelta& delta, size_t contents) : S{S}, delta{delta} {
+        hash = status_hash::scalars(delta.satiety, delta.remaining_time, delta.game_progress, delta.isLoadedOrEmpty,
+                                    delta.currentCellCoord) + contents;
+        if (delta.takenLogCell != StatusDelta::NoCell)
+            hash += status_hash::element(status_hash::LogCells, delta.takenLogCell, S.LogCellsContent[delta.takenLogCell]-1)
+                  - status_hash::element(status_hash::LogCells, delta.takenLogCell, S.LogCellsContent[delta.takenLogCell]);
+        if (delta.takenStoneCell != StatusDelta::NoCell)
+            hash += status_hash::element(status_hash::StoneCells, delta.takenStoneCell, S.StoneCellsContent[delta.takenStoneCell]-1)
+                  - status_hash::element(status_hash::StoneCells, delta.takenStoneCell, S.StoneCellsContent[delta.takenStoneCell]);
+        if (delta.unloads)
+            hash += status_hash::element(status_hash::UnloadZone, S.UnloadZoneContent.size(), (size_t)delta.unloadedItem);
+    }
+
+    /**
+     * Same fields as EnvironmentStatus::operator==
+     */
+    bool operator==(const EnvironmentStatus& x) const {
+        if ((delta.satiety != x.satiety) || (delta.remaining_time != x.remaining_time) ||
+            (delta.game_progress != x.game_progress) || (delta.isLoadedOrEmpty != x.isLoadedOrEmpty) ||
+            (delta.currentCellCoord != x.currentCellCoord))
+            return false;
+        if (!equalsTaking(S.LogCellsContent, x.LogCellsContent, delta.takenLogCell) ||
+            !equalsTaking(S.StoneCellsContent, x.StoneCellsContent, delta.takenStoneCell))
+            return false;
+        size_t N = S.UnloadZoneContent.size();
+        if (x.UnloadZoneContent.size() != N + (delta.unloads ? 1 : 0))
+            return false;
+        if (delta.unloads && (x.UnloadZoneContent[N] != delta.unloadedItem))
+            return false;
+        return std::equal(S.UnloadZoneContent.begin(), S.UnloadZoneContent.end(), x.UnloadZoneContent.begin());
+    }
+
+private:
+    template <typename T>
+    static bool equalsTaking(const std::pmr::vector<T>& before, const std::pmr::vector<T>& after, size_t taken) {
+        if (before.size() != after.size())
+            return false;
+        for (size_t i = 0, N = before.size(); i<N; i++)
+            if (((i == taken) ? before[i]-1 : before[i]) != after[i])
+                return false;
+        return true;
+    }
+};
+
+/**
+ * Hash and equality of the statuses stored in a graph, which can be also looked up as a status_successor
+ */
+struct status_key_hash {
+    using is_transparent = void;
+
+    size_t operator()(const EnvironmentStatus& x) const { return status_hash::of(x); }
+    size_t operator()(const status_successor& x) const { return x.hash; }
+};
+
+struct status_key_equal {
+    using is_transparent = void;
+
+    bool operator()(const EnvironmentStatus& lhs, const EnvironmentStatus& rhs) const { return lhs == rhs; }
+    bool operator()(const status_successor& lhs, const EnvironmentStatus& rhs) const { return lhs == rhs; }
+    bool operator()(const EnvironmentStatus& lhs, const status_successor& rhs) const { return rhs == lhs; }
+};
+
 #include <functional>
 
 using Predicate = std::function<bool(const struct EnvironmentStatus &)>;
@@ -302,23 +631,97 @@ struct SerializableRule {
     }
 };
 
+#include <memory>
+
+/**
+ * Sizes of a graph, updated by the explorer while the graph grows, so that they never require a further visit
+ */
+struct graph_counters {
+    size_t edges = 0;                   // One per rule
+    size_t prunedStates = 0;            // Marked as failing without expanding them, as they cannot reach acceptance
+    std::vector<size_t> outDegrees;     // How many expanded states have a given number of outgoing rules
+
+    void addExpandedState(size_t outDegree) {
+        if (outDegrees.size() <= outDegree)
+            outDegrees.resize(outDegree+1, 0);
+        outDegrees[outDegree]++;
+        edges += outDegree;
+    }
+
+    size_t expandedStates() const {
+        size_t result = 0;
+        for (size_t count : outDegrees)
+            result += count;
+        return result;
+    }
+};
+
 struct stateful_graph {
-    std::unordered_map<EnvironmentStatus, std::unordered_map<EnvironmentStatus, std::vector<SerializableRule>>> adjacency_graph;
-    std::unordered_set<EnvironmentStatus> accepting_states, failing_states;
+    // Targets are referred by their key in adjacency_graph, and rules reaching the same target are grouped together
+    using outgoing_edges = std::pmr::vector<std::pair<const EnvironmentStatus*, std::pmr::vector<SerializableRule>>>;
+
+    std::shared_ptr<graph_arena> arena;     // Declared first, so that it outlives the containers using it
+    std::pmr::unordered_map<EnvironmentStatus, outgoing_edges, status_key_hash, status_key_equal> adjacency_graph;
+    std::pmr::unordered_set<EnvironmentStatus> accepting_states, failing_states;
     EnvironmentStatus initial_state;
     std::vector<std::string> errors;
-
-    stateful_graph() = default;
-    stateful_graph(const stateful_graph& ) = default;
+    graph_counters counters;
+
+    stateful_graph(AllocationMode mode = AllocationMode::DefaultAllocation) :
+            arena{std::make_shared<graph_arena>(mode)},
+            adjacency_graph{arena->resource()},
+            accepting_states{arena->resource()},
+            failing_states{arena->resource()} {}
+    // Copies share the arena of the original graph, and their edges refer to their own keys
+    stateful_graph(const stateful_graph& x) :
+            arena{x.arena},
+            adjacency_graph{arena->resource()},
+            accepting_states{x.accepting_states, arena->resource()},
+            failing_states{x.failing_states, arena->resource()},
+            initial_state{x.initial_state},
+            errors{x.errors},
+            counters{x.counters} {
+        adjacency_graph.reserve(x.adjacency_graph.size());
+        for (const auto& cpM : x.adjacency_graph)
+            adjacency_graph.try_emplace(cpM.first);
+        for (const auto& cpM : x.adjacency_graph) {
+            outgoing_edges& outgoing = adjacency_graph.find(cpM.first)->second;
+            outgoing.reserve(cpM.second.size());
+            for (const auto& cp2M : cpM.second)
+                outgoing.emplace_back(std::piecewise_construct,
+                                      std::forward_as_tuple(&adjacency_graph.find(*cp2M.first)->first),
+                                      std::forward_as_tuple(cp2M.second));
+        }
+    }
     stateful_graph(stateful_graph&& ) = default;
-    stateful_graph& operator=(const stateful_graph& ) = default;
-    stateful_graph& operator=(stateful_graph&& ) = default;
+    // The assigned graph shares the arena of x, and its old containers are destroyed only after copying x
+    stateful_graph& operator=(const stateful_graph& x) {
+        return rebuild_in_place(*this, stateful_graph{x});
+    }
+    stateful_graph& operator=(stateful_graph&& x) noexcept {
+        return rebuild_in_place(*this, std::move(x));
+    }
+
+    allocation_stats memoryStats() const {
+        return arena->stats();
+    }
+
+    /**
+     * @param target    Key of adjacency_graph
+     * @return  The rules leading to the target, which are added to outgoing if none did before
+     */
+    static std::pmr::vector<SerializableRule>& rulesTo(outgoing_edges& outgoing, const EnvironmentStatus* target) {
+        for (auto& cp : outgoing)
+            if (cp.first == target)
+                return cp.second;
+        return outgoing.emplace_back(std::piecewise_construct, std::forward_as_tuple(target), std::forward_as_tuple()).second;
+    }
 
     friend std::ostream &operator<<(std::ostream &os, const stateful_graph &graph) {
         for (const auto& cpM : graph.adjacency_graph) {
             for (const auto& cp2M : cpM.second) {
                 for (const auto& rule : cp2M.second) {
-                    os << cpM.first << "--[" << rule << "]-->" << cp2M.first << std::endl;
+                    os << cpM.first << "--[" << rule << "]-->" << *cp2M.first << std::endl;
                 }
             }
         }
@@ -341,432 +744,2031 @@ struct stateful_graph {
         os << "\n\n";
         for (const auto& it : adjacency_graph) {
             for (const auto& multiedge_id : it.second) {
-                os << "q" << M[it.first] << " -> q" << M[multiedge_id.first] << ";\n";
+                os << "q" << M[it.first] << " -> q" << M[*multiedge_id.first] << ";\n";
             }
         }
         os << "}";
     }
 };
 
+#include <thread>
 
+/**
+ * Read-only snapshot of a graph, where the outgoing edges of each state are laid out contiguously (CSR layout).
+ * The states and the rules are referred by pointer, so the snapshot is only valid while the graph is not changed,
+ * while the probabilities are copied, so that they can be scanned linearly.
+ */
+struct compact_graph {
+    std::vector<const EnvironmentStatus*> states;
+    std::vector<bool> isFinal;                      // Accepting or failing states, which are not expanded further
+    std::vector<size_t> offsets;                    // The edges of states[i] are in [offsets[i], offsets[i+1])
+    std::vector<const EnvironmentStatus*> targets;
+    std::vector<const SerializableRule*> rules;
+    std::vector<double> probabilities;
+    std::vector<uint32_t> targetIds;                // Index of the target of each edge, once indexTargets is called
+    std::vector<std::pair<const EnvironmentStatus*, uint32_t>> byAddress;   // Sorted by the address of the state
+
+    compact_graph() = default;
+    /**
+     * @param nThreads  Number of threads looking up the final states, which are split in disjoint ranges
+     */
+    explicit compact_graph(const stateful_graph& G, size_t nThreads = std::thread::hardware_concurrency()) {
+        scoped_timer timer{"compact_graph"};
+        states.reserve(G.adjacency_graph.size());
+        offsets.reserve(G.adjacency_graph.size()+1);
+        offsets.emplace_back(0);
+        for (const auto& cpM : G.adjacency_graph) {
+            states.emplace_back(&cpM.first);
+            for (const auto& cp2M : cpM.second) {
+                for (const SerializableRule& rule : cp2M.second) {
+                    targets.emplace_back(cp2M.first);
+                    rules.emplace_back(&rule);
+                    probabilities.emplace_back(rule.probability);
+                }
+            }
+            offsets.emplace_back(rules.size());
+        }
 
-#include <cassert>
-#include <ostream>
-#include <iostream>
-
-struct Board {
-    struct EnvironmentStatus envStatus;
-    std::pair<size_t, size_t> boardSize;
-    std::pair<size_t, size_t> unloadingCoordinate;
-    std::pair<size_t, size_t> fillingStationCoordinate;
-    double gameProgressWeight;
-    double timeWeight;
-    double hungerWeight;
-    double maxSatiety;
-    double maxTime;
-    std::vector<std::pair<size_t, size_t>> LogCellsPosition, StoneCellsPosition;
-
-    double EatVsUnloadPreferrance = 0.8;
-    double EatAndUnloadVsRest = 0.7;
-    bool debug;
-
-    Board(size_t maxX,
-          size_t maxY,
-
-          size_t botX,
-          size_t botY,
-
-          size_t unloadingCoordinateX = 0,
-          size_t unloadingCoordinateY = 0,
-
-          size_t fillingCoordinateX = 0,
-          size_t fillingCoordinateY = 0,
-
-          double maxSatiety = 20,
-          double maxTime = 60) :
-            debug{false},
-            boardSize{maxX, maxY},
-            envStatus{botX, botY},
-            hungerWeight{0.2},
-            timeWeight{0.1},
-            maxSatiety{maxSatiety},
-            maxTime{maxTime},
-            gameProgressWeight{5.0},
-            unloadingCoordinate{unloadingCoordinateX, unloadingCoordinateY},
-            fillingStationCoordinate{fillingCoordinateX, fillingCoordinateY} {
-        assert(botX < maxX);
-        assert(botY < maxY);
-        envStatus.satiety = maxSatiety;
-        envStatus.remaining_time = maxTime;
+        // Bytes rather than bits, so that the threads never write the same word
+        size_t N = states.size();
+        std::vector<char> finalStates(N);
+        nThreads = std::max((size_t)1, std::min(nThreads, N / 4096 + 1));
+        auto scan = [this, &G, &finalStates, N, nThreads](size_t threadId) {
+            for (size_t i = (N * threadId) / nThreads, end = (N * (threadId+1)) / nThreads; i<end; i++)
+                finalStates[i] = G.accepting_states.contains(*states[i]) || G.failing_states.contains(*states[i]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t threadId = 1; threadId<nThreads; threadId++)
+            threads.emplace_back(scan, threadId);
+        scan(0);
+        for (std::thread& t : threads)
+            t.join();
+        isFinal.assign(finalStates.begin(), finalStates.end());
     }
+    compact_graph(const compact_graph& ) = default;
+    compact_graph(compact_graph&& ) = default;
+    compact_graph& operator=(const compact_graph& ) = default;
+    compact_graph& operator=(compact_graph&& ) = default;
 
-    void addLogCell(size_t x, size_t y, size_t start_quantity) {
-        LogCellsPosition.emplace_back(x, y);
-        envStatus.LogCellsContent.emplace_back(start_quantity);
+    size_t size() const {
+        return states.size();
     }
 
-    void addStoneCell(size_t x, size_t y, size_t start_quantity) {
-        StoneCellsPosition.emplace_back(x, y);
-        envStatus.StoneCellsContent.emplace_back(start_quantity);
+    /**
+     * @return The index of a state of the graph, or size() if the graph does not contain it
+     */
+    uint32_t indexOf(const stateful_graph& G, const EnvironmentStatus& S) const {
+        auto it = G.adjacency_graph.find(S);
+        if (it == G.adjacency_graph.end()) return (uint32_t)size();
+        return indexOfKey(&it->first);
     }
 
     /**
-     * Computing the expected reward from the state transition
-     *
-     * @param prev     Previous state
-     * @param current  Current state
-     * @return The reward to be associated for the transition
+     * @param key   Key of the graph, as the targets are
      */
-    double countWeightDifference(const struct EnvironmentStatus &prev,
-                                 const struct EnvironmentStatus &current) {
-        return hungerWeight * (((double) current.satiety) - ((double) prev.satiety)) +
-               timeWeight * (((double) current.remaining_time) - ((double) prev.remaining_time)) +
-               gameProgressWeight * (((double) current.game_progress) - ((double) prev.game_progress));
+    uint32_t indexOfKey(const EnvironmentStatus* key) const {
+        auto entry = std::lower_bound(byAddress.begin(), byAddress.end(), key,
+                                      [](const auto& lhs, const EnvironmentStatus* rhs) { return lhs.first < rhs; });
+        return entry->second;
     }
 
-    stateful_graph generatePossibleStates(std::ostream& os) {
-        stateful_graph G;
-        DFSGeneratePossibleStates(os, G, envStatus, envStatus.currentCellCoord);
-        return G;
+    /**
+     * Resolves the target of each edge into the index of the state, so that the graph can be visited by scanning
+     * integer arrays. As the targets are already keys of the graph, they are only looked up by address, by threads
+     * scanning disjoint ranges of edges.
+     */
+    void indexTargets(size_t nThreads = std::thread::hardware_concurrency()) {
+        scoped_timer timer{"indexTargets"};
+        byAddress.resize(size());
+        for (size_t i = 0, N = size(); i<N; i++)
+            byAddress[i] = {states[i], (uint32_t)i};
+        std::sort(byAddress.begin(), byAddress.end());
+        size_t E = targets.size();
+        targetIds.resize(E);
+        nThreads = std::max((size_t)1, std::min(nThreads, E / 4096 + 1));
+        auto scan = [this, E, nThreads](size_t threadId) {
+            for (size_t j = (E * threadId) / nThreads, end = (E * (threadId+1)) / nThreads; j<end; j++)
+                targetIds[j] = indexOfKey(targets[j]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t threadId = 1; threadId<nThreads; threadId++)
+            threads.emplace_back(scan, threadId);
+        scan(0);
+        for (std::thread& t : threads)
+            t.join();
     }
 
-private:
-
-    std::unordered_map<EnvironmentStatus, size_t> M;
-    size_t generateStateId(const EnvironmentStatus& S) {
-        size_t Sx = 0;
-        auto it = M.find(S);
-        if (it == M.end()) {
-            M[S] = Sx = M.size();
-        } else {
-            Sx = it->second;
+    /**
+     * Sums the probabilities of the edges leaving the i-th state. Four independent partial sums are kept, so that
+     * the compiler can map them to vector lanes without being allowed to reassociate floating point additions.
+     */
+    double outgoingMass(size_t i) const {
+        const double* it = probabilities.data() + offsets[i];
+        const double* end = probabilities.data() + offsets[i+1];
+        double lanes[4] = {0.0, 0.0, 0.0, 0.0};
+        for (; end - it >= 4; it += 4) {
+            lanes[0] += it[0];
+            lanes[1] += it[1];
+            lanes[2] += it[2];
+            lanes[3] += it[3];
         }
-        return Sx;
+        for (size_t lane = 0; it != end; it++, lane++)
+            lanes[lane] += *it;
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
     }
+};
 
-    void DFSGeneratePossibleStates(std::ostream& os, stateful_graph& G, const EnvironmentStatus& S, const std::pair<size_t, size_t>& prevCell) {
-        if (G.adjacency_graph.contains(S)) {
-            size_t srcId = generateStateId(S);
-            ///std::cout << " Already Met = " << srcId << std::endl;
-            return;
+/**
+ * State whose outgoing probability mass does not sum up to one
+ */
+struct probability_violation {
+    size_t stateIndex;      // Index within the compact graph
+    double mass;
+
+    void breakdown(std::ostream& os, const compact_graph& C) const {
+        os << "{" << *C.states[stateIndex] << "} has an outgoing probability mass of " << mass << std::endl;
+        for (size_t j = C.offsets[stateIndex], M = C.offsets[stateIndex+1]; j<M; j++) {
+            os << "  --[" << *C.rules[j] << "]-->{" << *C.targets[j] << "}" << std::endl;
         }
-        else {
-            size_t srcId = generateStateId(S);
-            /*if (srcId >500000) {
-                os.flush();
-                return;
-            }*/
-            ///std::cout << " * " << srcId << std::endl;
-            size_t dstId;
-
-            //std::cout << S << std::endl;
-            G.adjacency_graph[S] = {};
-            if (S.isIgnited && (S.remaining_time >= 0)) {
-                os << "Accepting state is reached! " << srcId << " with remaining time " << S.remaining_time << " and food " << S.satiety << std::endl;
-                G.accepting_states.insert(S);       // Finishing the game, if in the former state I ignited.
-            } else if ((S.remaining_time <= 0)) {
-                ///os << "Failing state is reached! " << srcId << std::endl;
-                G.failing_states.insert(S);         // Otherwise, at this time no further action is allowed
-            } else if (S.satiety == 0)  {
-                G.failing_states.insert(S);         // If I ran out of fuel, then I also lose the game
-            } else {
-                bool preferToEat = false;           // Prioritize the move towards the gas station
-                bool preferToUnload = false;        // Prioritize the move towards the unloading zone
-                double eatingPreferranceIfIsPreferToEat = 0.0;    // If gas station should be prioritized, calculate the probability of moving there
-                double unloadPreferranceIfIsPreferToUnload = 0.0; // If Loading zone should be prioritized, calculate the probability of moving there
-                double countOtherMovements = 0.0;
-                double remainingProbability = 1.0;
-
-                {
-                    double tradeOff = 0.0;
-
-                    if (std::floor(pairDistance(S.currentCellCoord, fillingStationCoordinate)) >= S.satiety) {
-                        preferToEat = true;
-                        eatingPreferranceIfIsPreferToEat = 1.0 - ((S.satiety)/(S.satiety+1.0));
-                    }
-                    if ((S.isLoadedOrEmpty != LoadType::FuelOrNoop)) {
-                        preferToUnload = true;
-                        unloadPreferranceIfIsPreferToUnload = std::floor(pairDistance(S.currentCellCoord, unloadingCoordinate));
-                        unloadPreferranceIfIsPreferToUnload = (unloadPreferranceIfIsPreferToUnload/(unloadPreferranceIfIsPreferToUnload+1.0));
-                    }
-                    tradeOff = EatVsUnloadPreferrance * (eatingPreferranceIfIsPreferToEat) + (1.0-EatVsUnloadPreferrance) * unloadPreferranceIfIsPreferToUnload;
-                    if (tradeOff > 0.0) {
-                        eatingPreferranceIfIsPreferToEat = EatAndUnloadVsRest * EatVsUnloadPreferrance * (eatingPreferranceIfIsPreferToEat) / tradeOff;
-                        unloadPreferranceIfIsPreferToUnload = EatAndUnloadVsRest * (1.0-EatVsUnloadPreferrance) * (unloadPreferranceIfIsPreferToUnload) / tradeOff;
-                        remainingProbability -= eatingPreferranceIfIsPreferToEat;
-                        remainingProbability -= unloadPreferranceIfIsPreferToUnload;
-                    }
-                }
-
-                if ((S.satiety >= 2.1) &&
-                    (S.currentCellCoord == unloadingCoordinate) &&
-                        S.isExactAmount()/*(std::find(S.UnloadZoneContent.begin(), S.UnloadZoneContent.end(), LoadType::OneStone)) != S.UnloadZoneContent.end()*/) {
-                    EnvironmentStatus result = S;
-                    result.satiety -= 1.0;
-                    result.nActionsPerformed++;
-                    result.remaining_time--;
-                    result.UnloadZoneContent.emplace_back(LoadType::FuelOrNoop);
-                    if (result.isGameProgressPositive())
-                        result.game_progress++;
-                    SerializableRule rule{RuleCases::UnloadResource};
-                    rule.feedback = countWeightDifference(S, result);
-                    G.adjacency_graph[S][result].emplace_back(rule);
-                    dstId = generateStateId(result);
-                    if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                    DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                    countOtherMovements++;
-                }
+    }
+};
 
-                if ((S.satiety >= 0.1) &&
-                    (S.currentCellCoord == unloadingCoordinate) &&
-                    (S.isRightAmount())) {
-                    EnvironmentStatus result = S;
-                    result.isIgnited = true;
-                    result.nActionsPerformed++;
-                    result.satiety -= 0.1;
-                    result.remaining_time--;
-                    if (result.isGameProgressPositive())
-                        result.game_progress++;
-                    SerializableRule rule{RuleCases::Ignite};
-                    rule.feedback = countWeightDifference(S, result);
-                    G.adjacency_graph[S][result].emplace_back(rule);
-                    dstId = generateStateId(result);
-                    if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                    DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                    countOtherMovements++;
-                }
+/**
+ * Checks that the rules leaving each expanded state form a probability distribution
+ *
+ * @param C             Snapshot of the graph to be checked
+ * @param tolerance     Maximum admitted distance of the outgoing mass from one
+ * @param nThreads      Number of threads scanning disjoint ranges of states
+ * @return All the offending states, in the same order as the compact graph
+ */
+std::vector<probability_violation> validateProbabilityMass(const compact_graph& C,
+                                                           double tolerance = 0.000000000000001,
+                                                           size_t nThreads = std::thread::hardware_concurrency()) {
+    size_t N = C.size();
+    nThreads = std::max((size_t)1, std::min(nThreads, N / 4096 + 1));
+    std::vector<std::vector<probability_violation>> partial(nThreads);
+    auto scan = [&C, &partial, tolerance, N, nThreads](size_t threadId) {
+        scoped_timer timer{"validateProbabilityMass"};
+        size_t begin = (N * threadId) / nThreads, end = (N * (threadId+1)) / nThreads;
+        for (size_t i = begin; i<end; i++) {
+            // Final states are not expanded, and the failing ones might still have some non-movement rules
+            if (C.isFinal[i] || (C.offsets[i] == C.offsets[i+1])) continue;
+            double mass = C.outgoingMass(i);
+            if (std::abs(mass - 1.0) > tolerance)
+                partial[threadId].push_back({i, mass});
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t threadId = 1; threadId<nThreads; threadId++)
+        threads.emplace_back(scan, threadId);
+    scan(0);
+    for (std::thread& t : threads)
+        t.join();
+
+    std::vector<probability_violation> result;
+    for (const auto& violations : partial)
+        result.insert(result.end(), violations.begin(), violations.end());
+    return result;
+}
 
-                if ((S.isLoadedOrEmpty != LoadType::FuelOrNoop) &&
-                        (S.currentCellCoord == unloadingCoordinate) &&
-                        (S.satiety >= 0.1)) {
-
-                    EnvironmentStatus result = S;
-                    result.UnloadZoneContent.emplace_back(S.isLoadedOrEmpty);
-                    result.isLoadedOrEmpty = LoadType::FuelOrNoop;
-                    result.remaining_time--;
-                    result.nActionsPerformed++;
-                    result.satiety -= 0.1;
-                    if (result.isGameProgressPositive())
-                        result.game_progress++;
-                    SerializableRule rule{RuleCases::UnloadResource};
-                    rule.feedback = countWeightDifference(S, result);
-                    G.adjacency_graph[S][result].emplace_back(rule);
-                    dstId = generateStateId(result);
-                    if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                    DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                    countOtherMovements++;
-                }
+#include <atomic>
+#include <barrier>
+#include <cassert>
+#include <optional>
 
-                for (size_t i = 0, N = LogCellsPosition.size(); i<N; i++) {
-                    const std::pair<size_t, size_t>& logCoord = LogCellsPosition.at(i);
-                    if ((S.currentCellCoord == logCoord) && (S.LogCellsContent.at(i) > 0) && (S.isLoadedOrEmpty == LoadType::FuelOrNoop) && (S.satiety >= 0.1)) {
-
-                        EnvironmentStatus result = S;
-                        result.isLoadedOrEmpty = LoadType::OneLog;
-                        result.remaining_time--;
-                        result.nActionsPerformed++;
-                        result.LogCellsContent[i]--;
-                        result.satiety -= 0.1;
-                        SerializableRule rule{RuleCases::LoadResource};
-                        rule.feedback = countWeightDifference(S, result);
-                        G.adjacency_graph[S][result].emplace_back(rule);
-                        dstId = generateStateId(result);
-                        if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                        DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                        countOtherMovements++;
-                    }
-                }
+/**
+ * Level-synchronous breadth-first visit, where the threads are started once and wait for each other at the end of
+ * each level. The states of a level are handed out in chunks through an atomic counter, and a state joins the next
+ * level only through the thread which first sets its distance.
+ *
+ * @param offsets       The edges of the i-th state are in [offsets[i], offsets[i+1])
+ * @param adjacent      Index of the state reached by each edge
+ * @param sources       States at distance zero
+ * @param expandable    Whether the edges leaving a state can be followed
+ * @return The least number of edges from any source to each state, or UINT32_MAX if it cannot be reached
+ */
+template <typename Expandable>
+std::vector<uint32_t> parallelBFS(const std::vector<size_t>& offsets,
+                                  const std::vector<uint32_t>& adjacent,
+                                  const std::vector<uint32_t>& sources,
+                                  Expandable&& expandable,
+                                  size_t nThreads = std::thread::hardware_concurrency()) {
+    scoped_timer timer{"parallelBFS"};
+    constexpr size_t Chunk = 1024;
+    size_t N = offsets.size()-1;
+    size_t T = std::max((size_t)1, std::min(nThreads, N / Chunk + 1));
+    std::vector<std::atomic<uint32_t>> distance(N);
+    for (std::atomic<uint32_t>& d : distance)
+        d.store(UINT32_MAX, std::memory_order_relaxed);
+    std::vector<uint32_t> frontier;
+    for (uint32_t source : sources) {
+        if (distance[source].exchange(0, std::memory_order_relaxed) == UINT32_MAX)
+            frontier.push_back(source);
+    }
 
-                for (size_t i = 0, N = StoneCellsPosition.size(); i<N; i++) {
-                    const std::pair<size_t, size_t>& stoneCoord = StoneCellsPosition.at(i);
-                    if ((S.currentCellCoord == stoneCoord) && (S.StoneCellsContent.at(i) > 0) && (S.isLoadedOrEmpty == LoadType::FuelOrNoop) && (S.satiety >= 0.1)) {
-
-                        EnvironmentStatus result = S;
-                        result.isLoadedOrEmpty = LoadType::OneStone;
-                        result.remaining_time--;
-                        result.nActionsPerformed++;
-                        result.StoneCellsContent[i]--;
-                        result.satiety -= 0.1;
-                        SerializableRule rule{RuleCases::LoadResource};
-                        rule.feedback = countWeightDifference(S, result);
-                        G.adjacency_graph[S][result].emplace_back(rule);
-                        dstId = generateStateId(result);
-                        if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                        DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                        countOtherMovements++;
+    std::vector<std::vector<uint32_t>> next(T);
+    std::atomic<size_t> nextChunk{0};
+    uint32_t level = 1;
+    bool done = frontier.empty();
+    // Run by a single thread once all of them visited the level, before any of them starts the next one
+    auto completeLevel = [&]() noexcept {
+        frontier.clear();
+        for (std::vector<uint32_t>& local : next) {
+            frontier.insert(frontier.end(), local.begin(), local.end());
+            local.clear();
+        }
+        nextChunk.store(0, std::memory_order_relaxed);
+        level++;
+        done = frontier.empty();
+    };
+    std::barrier sync{(std::ptrdiff_t)T, completeLevel};
+    auto visit = [&](size_t threadId) {
+        std::vector<uint32_t>& local = next[threadId];
+        while (!done) {
+            size_t F = frontier.size();
+            for (size_t begin = nextChunk.fetch_add(Chunk); begin<F; begin = nextChunk.fetch_add(Chunk)) {
+                for (size_t k = begin, end = std::min(begin + Chunk, F); k<end; k++) {
+                    uint32_t state = frontier[k];
+                    if (!expandable(state)) continue;
+                    for (size_t j = offsets[state], M = offsets[state+1]; j<M; j++) {
+                        uint32_t target = adjacent[j], unvisited = UINT32_MAX;
+                        if ((distance[target].load(std::memory_order_relaxed) == UINT32_MAX) &&
+                            distance[target].compare_exchange_strong(unvisited, level, std::memory_order_relaxed))
+                            local.push_back(target);
                     }
                 }
+            }
+            sync.arrive_and_wait();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t threadId = 1; threadId<T; threadId++)
+        threads.emplace_back(visit, threadId);
+    visit(0);
+    for (std::thread& t : threads)
+        t.join();
+
+    std::vector<uint32_t> result(N);
+    for (size_t i = 0; i<N; i++)
+        result[i] = distance[i].load(std::memory_order_relaxed);
+    return result;
+}
 
-                if ((S.currentCellCoord == fillingStationCoordinate) && (S.satiety < maxSatiety) && (S.satiety > 0.0)) {
-                    EnvironmentStatus result = S;
-                    result.remaining_time--;
-                    result.nActionsPerformed++;
-                    result.satiety = std::min(maxSatiety, result.satiety+5.0);
-                    SerializableRule rule{RuleCases::GainEnergy};
-                    rule.feedback = countWeightDifference(S, result);
-                    G.adjacency_graph[S][result].emplace_back(rule);
-                    dstId = generateStateId(result);
-                    if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}"<< std::endl<< std::endl;
-                    DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                    countOtherMovements++;
-                }
+#include "scc.h"
 
-                std::vector<std::pair<Directions, std::pair<size_t, size_t>>> allowedDirections = generateDirections(S.currentCellCoord, boardSize.first, boardSize.second);
-                allowedDirections.erase(std::remove_if(allowedDirections.begin(), allowedDirections.end(), [prevCell](const auto& x) { return x.second == prevCell; } ), allowedDirections.end());
-                Directions priorityEatingCell, priorityUnloadCell;
-                size_t hasAtLeastOnePreferredMovement = 0;
-                if (preferToEat && (!allowedDirections.empty())) {
-                    priorityEatingCell = rankDirections(allowedDirections, fillingStationCoordinate).begin()->first;
-                }
-                if (preferToUnload && (!allowedDirections.empty())) {
-                    priorityUnloadCell = rankDirections(allowedDirections, unloadingCoordinate).begin()->first;
-                }
-                if (preferToEat && preferToUnload) {
-                    if (priorityEatingCell == priorityUnloadCell)
-                        hasAtLeastOnePreferredMovement = 1;
-                    else
-                        hasAtLeastOnePreferredMovement = 2;
-                } else if (preferToEat || preferToUnload) {
-                    hasAtLeastOnePreferredMovement = 1;
-                } else {
-                    hasAtLeastOnePreferredMovement = 0;
-                }
+/**
+ * Metrics for judging the balance of a board
+ */
+struct graph_statistics {
+    size_t states = 0;
+    size_t edges = 0;
+    std::vector<size_t> outDegrees;                     // How many expanded states have a given number of rules
+    size_t reachableStates = 0;                         // From the initial state
+    std::optional<uint32_t> shortestPathToAcceptance;   // Least rules leading from the initial state to acceptance
+    size_t winnableStates = 0;                          // From which an accepting state can be reached
+    size_t components = 0;                              // Strongly connected
+    size_t cyclicStates = 0;                            // Belonging to a component with a cycle
+    size_t unresolvedStates = 0;                        // Whose return did not converge, or leading to one
+    std::optional<double> uniformPolicyReturn;          // Expected feedback from the initial state, when each
+                                                        // rule is chosen with the same probability
+
+    friend std::ostream &operator<<(std::ostream &os, const graph_statistics &stats) {
+        size_t expanded = 0, maxDegree = 0;
+        double meanDegree = 0.0;
+        for (size_t degree = 0, N = stats.outDegrees.size(); degree<N; degree++) {
+            expanded += stats.outDegrees[degree];
+            meanDegree += (double)(degree * stats.outDegrees[degree]);
+            if (stats.outDegrees[degree]) maxDegree = degree;
+        }
+        os << " - Edges: " << stats.edges << " (out degree: mean " << (expanded ? meanDegree / expanded : 0.0)
+           << " max " << maxDegree << ")" << std::endl;
+        os << " - Reachable States: " << stats.reachableStates << std::endl;
+        os << " - Shortest Path to Acceptance: ";
+        if (stats.shortestPathToAcceptance) os << *stats.shortestPathToAcceptance; else os << "none";
+        os << std::endl << " - Winnable States: " << ((double)stats.winnableStates)/((double)stats.states) << std::endl;
+        os << " - Uniform Policy Return: ";
+        if (stats.uniformPolicyReturn) os << *stats.uniformPolicyReturn; else os << "undefined";
+        os << " (unresolved states: " << stats.unresolvedStates << ")" << std::endl;
+        os << " - Strongly Connected Components: " << stats.components << " (cyclic states: " << stats.cyclicStates
+           << ")";
+        return os;
+    }
+};
 
-                // Increase the cost of moving if the robot is loaded
-                double costNormalPace = 1.0;
-                double costFastPace = 2.0;
-                if (S.isLoadedOrEmpty != LoadType::FuelOrNoop) {
-                    costNormalPace += 0.5;
-                    costFastPace += 1.0;
-                }
+/**
+ * Computes the metrics over a compact snapshot of the graph, with breadth-first visits from the initial state and
+ * backwards from the accepting states. The expected return is solved one strongly connected component at a time, in
+ * reverse topological order: the states out of cycles are valued once, while the ones of a cyclic component are
+ * swept until their values stop changing, or are left unresolved after maxSweeps.
+ * The edges are followed as the explorer did: failing states left without movements may still have some rules.
+ * The out degrees come from the counters kept by the explorer.
+ */
+graph_statistics analyseGraph(const stateful_graph& G,
+                              size_t nThreads = std::thread::hardware_concurrency(),
+                              size_t maxSweeps = 1000,
+                              double tolerance = 1e-9) {
+    scoped_timer timer{"analyseGraph"};
+    compact_graph C{G, nThreads};
+    C.indexTargets(nThreads);
+    size_t N = C.size();
+    graph_statistics stats;
+    stats.states = N;
+    stats.edges = G.counters.edges;
+    stats.outDegrees = G.counters.outDegrees;
+    assert(stats.edges == C.targetIds.size());
+    uint32_t initial = C.indexOf(G, G.initial_state);
+    if (initial == N) return stats;
+
+    auto expandable = [](uint32_t) { return true; };
+    std::vector<uint32_t> fromInitial = parallelBFS(C.offsets, C.targetIds, {initial}, expandable, nThreads);
+    std::vector<uint32_t> accepting;
+    for (const EnvironmentStatus& S : G.accepting_states)
+        accepting.emplace_back(C.indexOf(G, S));
+    for (uint32_t distance : fromInitial)
+        if (distance != UINT32_MAX) stats.reachableStates++;
+    for (uint32_t i : accepting)
+        if ((fromInitial[i] != UINT32_MAX) && ((!stats.shortestPathToAcceptance) || (fromInitial[i] < *stats.shortestPathToAcceptance)))
+            stats.shortestPathToAcceptance = fromInitial[i];
+
+    // Incoming edges of each state
+    std::vector<size_t> reverseOffsets(N+1, 0);
+    for (uint32_t target : C.targetIds)
+        reverseOffsets[target+1]++;
+    for (size_t i = 0; i<N; i++)
+        reverseOffsets[i+1] += reverseOffsets[i];
+    std::vector<uint32_t> reverseSources(reverseOffsets[N]);
+    {
+        std::vector<size_t> fill(reverseOffsets.begin(), reverseOffsets.end()-1);
+        for (size_t i = 0; i<N; i++)
+            for (size_t j = C.offsets[i], M = C.offsets[i+1]; j<M; j++)
+                reverseSources[fill[C.targetIds[j]]++] = (uint32_t)i;
+    }
+    std::vector<uint32_t> toAcceptance = parallelBFS(reverseOffsets, reverseSources, accepting, expandable, nThreads);
+    for (uint32_t distance : toAcceptance)
+        if (distance != UINT32_MAX) stats.winnableStates++;
+
+    // Successors are always valued before their predecessors, unless they share a cycle
+    strongly_connected_components components = tarjan(C.offsets, C.targetIds);
+    stats.components = components.size();
+    std::vector<double> value(N, 0.0);
+    std::vector<char> resolved(N, 1);
+    auto backup = [&](uint32_t i) {
+        size_t rules = C.offsets[i+1] - C.offsets[i];
+        if (rules == 0) return 0.0;
+        double sum = 0.0;
+        for (size_t j = C.offsets[i], M = C.offsets[i+1]; j<M; j++) {
+            sum += C.rules[j]->feedback + value[C.targetIds[j]];
+            resolved[i] = resolved[i] && resolved[C.targetIds[j]];
+        }
+        double change = std::abs(value[i] - sum / (double)rules);
+        value[i] = sum / (double)rules;
+        return change;
+    };
+    solve_by_components(components, C.offsets, C.targetIds, [&](size_t c) {
+        auto nodes = components.nodes(c);
+        if (!components.cyclic[c]) {
+            backup(nodes[0]);
+            return;
+        }
+        double Delta = tolerance+1.0;
+        for (size_t sweep = 0; (sweep<maxSweeps) && (Delta > tolerance); sweep++) {
+            Delta = 0.0;
+            for (uint32_t i : nodes)
+                Delta = std::max(Delta, backup(i));
+        }
+        if (Delta > tolerance)
+            for (uint32_t i : nodes)
+                resolved[i] = 0;
+    }, nThreads);
+    for (size_t c = 0; c<components.size(); c++)
+        if (components.cyclic[c])
+            stats.cyclicStates += components.nodes(c).size();
+    for (size_t i = 0; i<N; i++)
+        if (!resolved[i]) stats.unresolvedStates++;
+    if (resolved[initial])
+        stats.uniformPolicyReturn = value[initial];
+    return stats;
+}
+
+#include <ostream>
+#include <iostream>
+#include <deque>
+#include <optional>
+#include <bit>
+#include <random>
+#include <limits>
+#include "instrumentation.h"
+
+/**
+ * Kind of edit performed on a board between two subsequent graph generations
+ */
+enum ParameterChange {
+    NoChange = 0,
+    WeightsChanged = 1,         // Only affects SerializableRule::feedback
+    PreferencesChanged = 2,     // Only affects SerializableRule::probability
+    StructureChanged = 4        // Affects the set of reachable states, and requires a new exploration
+};
+
+/**
+ * Classification of a status with respect to the end of the game
+ */
+enum StatusKind {
+    ExpandableStatus = 0,
+    AcceptingStatus = 1,
+    FailingStatus = 2
+};
+
+/**
+ * Outcome of a bounded-horizon lookahead from a status
+ */
+struct PlannedAction {
+    bool found = false;             // Whether any rule can be applied to the status
+    SerializableRule rule;          // Rule to be applied next
+    double value = 0.0;             // Expected return of the rule within the horizon
+    size_t expandedStates = 0;
+    size_t tableHits = 0;
+
+    friend std::ostream &operator<<(std::ostream &os, const PlannedAction &action) {
+        os << "found: " << action.found << " rule: {" << action.rule << "} value: " << action.value
+           << " expandedStates: " << action.expandedStates << " tableHits: " << action.tableHits;
+        return os;
+    }
+};
+
+/**
+ * Budget and tuning of the Monte Carlo Tree Search
+ */
+struct UCTParameters {
+    size_t iterations = 10000;      // Overall number of simulations, shared among the threads
+    size_t threads = 1;             // Each thread grows an independent tree, merged at the root
+    size_t horizon = 50;            // Maximum number of rules applied, the root one included, as in planNextAction
+    double exploration = 1.0;       // UCB1 constant, to be scaled as the feedback
+    double gamma = 1.0;             // Discount factor of the feedback
+    uint_fast64_t seed = 0;
+};
+
+/**
+ * Statistics of a rule applicable to the status being planned for
+ */
+struct ActionStatistics {
+    SerializableRule rule;
+    size_t visits = 0;
+    double meanReturn = 0.0;
+
+    friend std::ostream &operator<<(std::ostream &os, const ActionStatistics &stats) {
+        os << "rule: {" << stats.rule << "} visits: " << stats.visits << " meanReturn: " << stats.meanReturn;
+        return os;
+    }
+};
+
+/**
+ * Counters of a graph generation, only collected when compiling with GOAP_INSTRUMENTATION
+ */
+struct ExplorationCounters {
+    size_t expandedStates = 0;      // States met for the first time
+    size_t duplicateHits = 0;       // States met again, and not expanded
+    size_t acceptingStates = 0;
+    size_t failingStates = 0;
+    size_t depth = 0;               // Recursion depth of the last expanded state
+    size_t maxDepth = 0;
+    std::array<size_t, 7> successorsPerCase{};      // Indexed by RuleCases - NOOP
+    double loadFactor = 0.0;        // Of the graph adjacency map
+    size_t bucketCount = 0;
+    allocation_stats memory{};
+    double elapsedSeconds = 0.0;
+
+    friend std::ostream &operator<<(std::ostream &os, const ExplorationCounters &counters) {
+        os << "[" << counters.elapsedSeconds << " s] expanded: " << counters.expandedStates << " duplicates: "
+           << counters.duplicateHits << " accepting: " << counters.acceptingStates << " failing: "
+           << counters.failingStates << " depth: " << counters.depth << " (max " << counters.maxDepth
+           << ") successors:";
+        for (size_t i = 0, N = counters.successorsPerCase.size(); i<N; i++)
+            if (counters.successorsPerCase[i])
+                os << " " << (RuleCases)(RuleCases::NOOP + i) << "=" << counters.successorsPerCase[i];
+        os << " load factor: " << counters.loadFactor << " (" << counters.bucketCount << " buckets) bytes: "
+           << counters.memory.requested_bytes;
+        return os;
+    }
+};
+
+#include <cstdint>
+#include <map>
+
+/**
+ * States sharing the same remaining time, together with the rules leaving them. As each rule consumes some time, the
+ * rules of a layer only lead to the following ones.
+ */
+struct time_layer {
+    static constexpr int64_t TicksPerTimeUnit = 2;      // Fast movements take half a time unit
+
+    /**
+     * Rule leading to the target-th state of the layer with targetTicks
+     */
+    struct edge {
+        SerializableRule rule;
+        int64_t targetTicks;
+        uint32_t target;
+    };
+
+    int64_t ticks = 0;                                          // Remaining time of the states
+    std::vector<EnvironmentStatus> states;
+    std::vector<std::pair<size_t, size_t>> prevCells;           // From which each state was first reached
+    std::vector<StatusKind> kinds;
+    std::vector<size_t> offsets{0};                             // The edges of the i-th state are in
+    std::vector<edge> edges;                                    // [offsets[i], offsets[i+1])
+
+    size_t size() const {
+        return states.size();
+    }
+
+    static int64_t toTicks(double remaining_time) {
+        return std::llround(remaining_time * TicksPerTimeUnit);
+    }
+};
+
+#include <cstdio>
+#include <cstring>
+#include "external_memory.h"
+
+/**
+ * What distinguishes the copies of a status generated more than once, which is not part of the status equality
+ */
+struct external_payload {
+    uint64_t sequence;              // Generation order, so that the first copy is kept as in generateLayers
+    uint64_t nActionsPerformed;
+    uint64_t prevCellX, prevCellY;  // Cell from which the status was reached
+    bool isIgnited;
+};
+
+/**
+ * Writes in key the fields compared by the status equality, so that equal statuses have the same bytes
+ */
+void encodeStatus(const EnvironmentStatus& S, std::string& key) {
+    key.clear();
+    auto append = [&key](const auto& x) {
+        key.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    };
+    append(S.satiety);
+    append(S.remaining_time);
+    append(S.game_progress);
+    append(S.isLoadedOrEmpty);
+    append(S.currentCellCoord.first);
+    append(S.currentCellCoord.second);
+    append((uint32_t)S.LogCellsContent.size());
+    for (size_t x : S.LogCellsContent)
+        append(x);
+    append((uint32_t)S.StoneCellsContent.size());
+    for (size_t x : S.StoneCellsContent)
+        append(x);
+    append((uint32_t)S.UnloadZoneContent.size());
+    for (LoadType x : S.UnloadZoneContent)
+        append(x);
+}
+
+/**
+ * Inverse of encodeStatus, also restoring the fields kept in the payload
+ */
+void decodeStatus(const std::string& key, const external_payload& payload, EnvironmentStatus& S) {
+    const char* ptr = key.data();
+    auto extract = [&ptr](auto& x) {
+        std::memcpy(&x, ptr, sizeof(x));
+        ptr += sizeof(x);
+    };
+    auto extractVector = [&extract](auto& v) {
+        uint32_t size;
+        extract(size);
+        v.resize(size);
+        for (auto& x : v)
+            extract(x);
+    };
+    extract(S.satiety);
+    extract(S.remaining_time);
+    extract(S.game_progress);
+    extract(S.isLoadedOrEmpty);
+    extract(S.currentCellCoord.first);
+    extract(S.currentCellCoord.second);
+    extractVector(S.LogCellsContent);
+    extractVector(S.StoneCellsContent);
+    extractVector(S.UnloadZoneContent);
+    assert(ptr == key.data() + key.size());
+    S.nActionsPerformed = payload.nActionsPerformed;
+    S.isIgnited = payload.isIgnited;
+}
+
+/**
+ * Settings of the generation keeping the states on disk
+ */
+struct external_memory_parameters {
+    std::string directory = ".";        // Where the runs are written, and deleted once read
+    size_t batchStates = 1 << 20;       // States of a layer kept in memory before being written as a sorted run
+    size_t bloomBits = 1 << 26;         // Of the filter screening the states of a layer against its runs
+    size_t bloomHashes = 4;
+};
+
+/**
+ * Outcome of the generation keeping the states on disk
+ */
+struct external_memory_counters {
+    size_t states = 0;
+    size_t acceptingStates = 0;
+    size_t failingStates = 0;
+    size_t prunedStates = 0;
+    size_t layers = 0;
+    size_t widestLayer = 0;
+    size_t generatedStates = 0;     // The initial status and the successors, duplicates included
+    size_t duplicates = 0;
+    size_t screenedStates = 0;      // Successors which the filter proved not to be in the runs already written
+    size_t runs = 0;
+    size_t mergedLayers = 0;        // Whose runs possibly shared some states, and were merged
+    size_t writtenBytes = 0;
+
+    friend std::ostream &operator<<(std::ostream &os, const external_memory_counters &counters) {
+        os << counters.states << " (layers: " << counters.layers << ", widest: " << counters.widestLayer
+           << ") accepting: " << counters.acceptingStates << " failing: " << counters.failingStates << " pruned: "
+           << counters.prunedStates << std::endl;
+        os << " - Generated: " << counters.generatedStates << " (duplicates: " << counters.duplicates
+           << ", screened: " << counters.screenedStates << ")" << std::endl;
+        os << " - Runs: " << counters.runs << " (merged layers: " << counters.mergedLayers << ", bytes: "
+           << counters.writtenBytes << ")";
+        return os;
+    }
+};
+
+/**
+ * Snapshot of the designer-tunable fields of a Board, so to detect what changed after an edit
+ */
+struct BoardParameters {
+    EnvironmentStatus envStatus;
+    std::pair<size_t, size_t> boardSize;
+    std::pair<size_t, size_t> unloadingCoordinate;
+    std::pair<size_t, size_t> fillingStationCoordinate;
+    double gameProgressWeight;
+    double timeWeight;
+    double hungerWeight;
+    double maxSatiety;
+    double maxTime;
+    std::vector<std::pair<size_t, size_t>> LogCellsPosition, StoneCellsPosition;
+    double EatVsUnloadPreferrance;
+    double EatAndUnloadVsRest;
+    bool allowFastMoves;
+    bool pruneHopelessStates;
+};
+
+struct Board {
+    using Successor = std::pair<SerializableRule, StatusDelta>;     // Applicable rule, and the change it performs
+
+    struct EnvironmentStatus envStatus;
+    std::pair<size_t, size_t> boardSize;
+    std::pair<size_t, size_t> unloadingCoordinate;
+    std::pair<size_t, size_t> fillingStationCoordinate;
+    double gameProgressWeight;
+    double timeWeight;
+    double hungerWeight;
+    double maxSatiety;
+    double maxTime;
+    std::vector<std::pair<size_t, size_t>> LogCellsPosition, StoneCellsPosition;
+
+    double EatVsUnloadPreferrance = 0.8;
+    double EatAndUnloadVsRest = 0.7;
+    bool allowFastMoves = false;        // Whether a well-fed robot can also move at a fast pace
+    bool pruneHopelessStates = false;   // Whether the states which cannot reach acceptance are left unexpanded
+    bool debug;
+    AllocationMode allocationMode = AllocationMode::DefaultAllocation;   // Used by the generated graphs
+    size_t transpositionTableSize = 1 << 16;                            // Entries memoised by planNextAction
+    ExplorationCounters counters;                                       // Of the last graph generation
+    std::function<void(const ExplorationCounters&)> onProgress;         // Called periodically during the generation
+    progress_timer progressTimer;
+
+    Board(size_t maxX,
+          size_t maxY,
+
+          size_t botX,
+          size_t botY,
+
+          size_t unloadingCoordinateX = 0,
+          size_t unloadingCoordinateY = 0,
+
+          size_t fillingCoordinateX = 0,
+          size_t fillingCoordinateY = 0,
+
+          double maxSatiety = 20,
+          double maxTime = 60) :
+            debug{false},
+            boardSize{maxX, maxY},
+            envStatus{botX, botY},
+            hungerWeight{0.2},
+            timeWeight{0.1},
+            maxSatiety{maxSatiety},
+            maxTime{maxTime},
+            gameProgressWeight{5.0},
+            unloadingCoordinate{unloadingCoordinateX, unloadingCoordinateY},
+            fillingStationCoordinate{fillingCoordinateX, fillingCoordinateY} {
+        assert(botX < maxX);
+        assert(botY < maxY);
+        envStatus.satiety = maxSatiety;
+        envStatus.remaining_time = maxTime;
+    }
 
+    void addLogCell(size_t x, size_t y, size_t start_quantity) {
+        LogCellsPosition.emplace_back(x, y);
+        envStatus.LogCellsContent.emplace_back(start_quantity);
+    }
 
-                bool doFastPace = false;(!allowedDirections.empty()) && (S.satiety >= costFastPace);
-                bool hasAnyMove = (!allowedDirections.empty()) && (S.satiety >= costNormalPace);
+    void addStoneCell(size_t x, size_t y, size_t start_quantity) {
+        StoneCellsPosition.emplace_back(x, y);
+        envStatus.StoneCellsContent.emplace_back(start_quantity);
+    }
 
-                if (!hasAnyMove) {
-                    ///os << "Failing state is reached! " << srcId << std::endl;
-                    G.failing_states.insert(S);
+    /**
+     * Computing the expected reward from the state transition
+     *
+     * @param prev     Previous state
+     * @param current  Current state
+     * @return The reward to be associated for the transition
+     */
+    double countWeightDifference(const struct EnvironmentStatus &prev,
+                                 const struct EnvironmentStatus &current) const {
+        return hungerWeight * (((double) current.satiety) - ((double) prev.satiety)) +
+               timeWeight * (((double) current.remaining_time) - ((double) prev.remaining_time)) +
+               gameProgressWeight * (((double) current.game_progress) - ((double) prev.game_progress));
+    }
+
+    /**
+     * Computing the expected reward from the state transition, without materialising the current state
+     *
+     * @param prev     Previous state
+     * @param delta    Change leading from the previous state to the current one
+     * @return The reward to be associated for the transition
+     */
+    double countWeightDifference(const struct EnvironmentStatus &prev,
+                                 const StatusDelta &delta) const {
+        return hungerWeight * (((double) delta.satiety) - ((double) prev.satiety)) +
+               timeWeight * (((double) delta.remaining_time) - ((double) prev.remaining_time)) +
+               gameProgressWeight * (((double) delta.game_progress) - ((double) prev.game_progress));
+    }
+
+    /**
+     * @param S     Status to be classified
+     * @return  Whether the game is won or lost in S, or whether S still has to be expanded
+     */
+    StatusKind statusKind(const EnvironmentStatus& S) const {
+        if (S.isIgnited && (S.remaining_time >= 0))
+            return StatusKind::AcceptingStatus;     // Finishing the game, if in the former state I ignited.
+        else if ((S.remaining_time <= 0))
+            return StatusKind::FailingStatus;       // Otherwise, at this time no further action is allowed
+        else if (S.satiety == 0)
+            return StatusKind::FailingStatus;       // If I ran out of fuel, then I also lose the game
+        else
+            return StatusKind::ExpandableStatus;
+    }
+
+    stateful_graph generatePossibleStates(std::ostream& os) {
+        stateful_graph G{allocationMode};
+        G.initial_state = envStatus;
+        geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+        M.emplace(allocationMode);
+        if constexpr (instrumentation_enabled) {
+            counters = {};
+            progressTimer.restart();
+        }
+        {
+            scoped_timer timer{"DFSGeneratePossibleStates"};
+            auto& initial = *G.adjacency_graph.try_emplace(envStatus).first;
+            DFSGeneratePossibleStates(os, G, initial.first, initial.second, envStatus.currentCellCoord);
+        }
+        if constexpr (instrumentation_enabled)
+            reportProgress(G);
+        M.reset();
+        return G;
+    }
+
+    /**
+     * Generates the graph one time layer at a time, from the initial status onwards. Each layer is handed to the sink
+     * as soon as all of its states are expanded, and then freed: only the layer being expanded and the ones reached by
+     * its rules are kept in memory, and the states are only deduplicated within their layer. Differently from the
+     * depth-first generation, the movement leading back is excluded with respect to the first predecessor in the
+     * layer order.
+     *
+     * @param sink  Receives the layers by decreasing remaining time
+     * @return  Number of generated states
+     */
+    size_t generateLayers(const std::function<void(const time_layer&)>& sink) {
+        scoped_timer timer{"generateLayers"};
+        geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+        struct pending_layer {
+            time_layer layer;
+            std::unordered_map<EnvironmentStatus, uint32_t> ids;
+        };
+        std::map<int64_t, pending_layer, std::greater<>> pending;
+        auto idOf = [&pending](const EnvironmentStatus& S, const std::pair<size_t, size_t>& prevCell) {
+            int64_t ticks = time_layer::toTicks(S.remaining_time);
+            pending_layer& next = pending[ticks];
+            auto it = next.ids.find(S);
+            if (it != next.ids.end())
+                return std::make_pair(ticks, it->second);
+            uint32_t id = (uint32_t)next.layer.size();
+            next.layer.ticks = ticks;
+            next.layer.states.emplace_back(S);
+            next.layer.prevCells.emplace_back(prevCell);
+            next.ids.emplace(S, id);
+            return std::make_pair(ticks, id);
+        };
+
+        idOf(envStatus, envStatus.currentCellCoord);
+        size_t count = 0;
+        std::vector<Successor> successors;
+        EnvironmentStatus successor;
+        while (!pending.empty()) {
+            // No rule leads back to the layer, whose identifiers are not needed anymore
+            time_layer layer = std::move(pending.begin()->second.layer);
+            pending.erase(pending.begin());
+            layer.kinds.reserve(layer.size());
+            layer.offsets.reserve(layer.size()+1);
+            for (size_t i = 0, N = layer.size(); i<N; i++) {
+                const EnvironmentStatus& S = layer.states[i];
+                StatusKind kind = statusKind(S);
+                layer.kinds.emplace_back(kind);
+                if ((kind == StatusKind::ExpandableStatus) && ((!pruneHopelessStates) || canStillIgnite(S))) {
+                    generateSuccessors(S, layer.prevCells[i], successors);
+                    successor = S;
+                    for (const Successor& cp : successors) {
+                        cp.second.apply(successor);
+                        auto [ticks, id] = idOf(successor, S.currentCellCoord);
+                        assert(ticks < layer.ticks);
+                        layer.edges.push_back({cp.first, ticks, id});
+                        cp.second.undo(successor, S);
+                    }
+                }
+                layer.offsets.emplace_back(layer.edges.size());
+            }
+            count += layer.size();
+            sink(layer);
+        }
+        return count;
+    }
+
+    /**
+     * Generates the same states as generateLayers, with the duplicates detected on disk. The successors of a layer
+     * are buffered in memory, and each full buffer is sorted and written as a run. When the layer is expanded, its
+     * runs are merged, only keeping the first generated copy of each status; the runs are not merged if the filter
+     * proved that no status was written twice. Then, each run is expanded in generation order, one at a time. A
+     * layer never filling its buffer is expanded without touching the disk. As no rule leads back to an earlier
+     * layer, no visited set is kept across layers.
+     *
+     * @param parameters    Where the runs go, and how much memory each layer uses
+     * @param sink          If any, receives each status once, by decreasing remaining time
+     */
+    external_memory_counters generateExternally(const external_memory_parameters& parameters,
+                                                const std::function<void(const EnvironmentStatus&, StatusKind)>& sink = {}) {
+        scoped_timer timer{"generateExternally"};
+        geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+        using record = run_record<external_payload>;
+        struct pending_layer {
+            std::vector<record> batch;
+            std::vector<std::string> runs;
+            std::optional<bloom_filter> filter;     // Of the statuses already in the runs
+            bool disjoint = true;                   // Whether no status was possibly written in more than one run
+        };
+        auto prefer = [](const external_payload& lhs, const external_payload& rhs) {
+            return lhs.sequence < rhs.sequence;
+        };
+        auto bySequence = [&prefer](const record& lhs, const record& rhs) {
+            return prefer(lhs.payload, rhs.payload);
+        };
+        external_memory_counters result;
+        std::map<int64_t, pending_layer, std::greater<>> pending;
+        uint64_t sequence = 0;
+
+        auto spill = [&](int64_t ticks, pending_layer& layer) {
+            if (layer.batch.empty()) return;
+            result.duplicates += sort_unique(layer.batch, prefer);
+            if (!layer.filter)
+                layer.filter.emplace(parameters.bloomBits, parameters.bloomHashes);
+            std::string path = parameters.directory + "/layer" + std::to_string(ticks) + ".run" + std::to_string(layer.runs.size());
+            run_writer<external_payload> writer{path};
+            for (const record& r : layer.batch) {
+                writer.write(r);
+                layer.filter->insert(std::hash<std::string>{}(r.key));
+            }
+            result.writtenBytes += writer.bytes;
+            result.runs++;
+            layer.runs.emplace_back(std::move(path));
+            layer.batch.clear();
+        };
+        auto push = [&](const EnvironmentStatus& S, const std::pair<size_t, size_t>& prevCell) {
+            int64_t ticks = time_layer::toTicks(S.remaining_time);
+            pending_layer& layer = pending[ticks];
+            record& r = layer.batch.emplace_back();
+            encodeStatus(S, r.key);
+            r.payload = {sequence++, S.nActionsPerformed, prevCell.first, prevCell.second, S.isIgnited};
+            result.generatedStates++;
+            if ((!layer.filter) || (!layer.filter->mayContain(std::hash<std::string>{}(r.key))))
+                result.screenedStates++;
+            else
+                layer.disjoint = false;
+            if (layer.batch.size() >= parameters.batchStates)
+                spill(ticks, layer);
+        };
+
+        push(envStatus, envStatus.currentCellCoord);
+        std::vector<Successor> successors;
+        EnvironmentStatus S, successor;
+        while (!pending.empty()) {
+            // No rule leads back to the layer, which is not going to receive further statuses
+            int64_t ticks = pending.begin()->first;
+            pending_layer layer = std::move(pending.begin()->second);
+            pending.erase(pending.begin());
+            size_t layerStates = 0;
+            auto expand = [&](const record& r) {
+                decodeStatus(r.key, r.payload, S);
+                StatusKind kind = statusKind(S);
+                if (kind == StatusKind::AcceptingStatus)
+                    result.acceptingStates++;
+                else if (kind == StatusKind::FailingStatus)
+                    result.failingStates++;
+                else if (pruneHopelessStates && (!canStillIgnite(S))) {
+                    result.failingStates++;
+                    result.prunedStates++;
                 } else {
-                    double equiprobableProbabilitySum = 1.0;
-                    ///double equiprobableProbability = 0.0;
-                    size_t totalUnprioritizedMovements = allowedDirections.size() - hasAtLeastOnePreferredMovement;
-                    if (preferToEat || preferToUnload) {
-                        equiprobableProbabilitySum = remainingProbability;
-                    } else {
-                        equiprobableProbabilitySum = 1.0;
+                    if (!generateSuccessors(S, {r.payload.prevCellX, r.payload.prevCellY}, successors))
+                        result.failingStates++;
+                    successor = S;
+                    for (const Successor& cp : successors) {
+                        cp.second.apply(successor);
+                        push(successor, S.currentCellCoord);
+                        cp.second.undo(successor, S);
+                    }
+                }
+                if (sink)
+                    sink(S, kind);
+                layerStates++;
+            };
+            if (layer.runs.empty()) {
+                result.duplicates += sort_unique(layer.batch, prefer);
+                std::sort(layer.batch.begin(), layer.batch.end(), bySequence);
+                for (const record& r : layer.batch)
+                    expand(r);
+            } else {
+                spill(ticks, layer);
+                if (!layer.disjoint) {
+                    // Each status is kept in the run of its first copy, so that the runs still follow the generation order
+                    result.mergedLayers++;
+                    std::vector<run_writer<external_payload>> merged;
+                    std::vector<std::string> paths;
+                    for (const std::string& path : layer.runs) {
+                        paths.emplace_back(path + ".merged");
+                        merged.emplace_back(paths.back());
                     }
-                    if (doFastPace) {
-                        totalUnprioritizedMovements *= 2;
-                        eatingPreferranceIfIsPreferToEat *= 0.5;
-                        unloadPreferranceIfIsPreferToUnload *= 0.5;
+                    result.duplicates += merge_runs<external_payload>(layer.runs, prefer, [&merged](size_t run, const record& r) {
+                        merged[run].write(r);
+                    });
+                    for (run_writer<external_payload>& writer : merged) {
+                        writer.out.close();
+                        result.writtenBytes += writer.bytes;
                     }
-                    countOtherMovements += totalUnprioritizedMovements;
+                    for (const std::string& path : layer.runs)
+                        std::remove(path.c_str());
+                    layer.runs = std::move(paths);
+                }
+                for (const std::string& path : layer.runs) {
+                    std::vector<record> run = read_run<external_payload>(path);
+                    std::remove(path.c_str());
+                    std::sort(run.begin(), run.end(), bySequence);
+                    for (const record& r : run)
+                        expand(r);
+                }
+            }
+            result.states += layerStates;
+            result.layers++;
+            result.widestLayer = std::max(result.widestLayer, layerStates);
+        }
+        return result;
+    }
 
+    /**
+     * Chooses the next rule to be applied from envStatus, without generating the graph. The rule maximising the
+     * expected return is chosen, while the following steps are expected to be chosen with the probabilities of
+     * the preference model, up to the horizon. Values are memoised in a transposition table of bounded size,
+     * which is kept across calls as long as only envStatus changes.
+     *
+     * @param horizon   Maximum number of rules to be applied, the chosen one included
+     * @param gamma     Discount factor of the feedback
+     * @return  The chosen rule, if any, and its expected return
+     */
+    PlannedAction planNextAction(size_t horizon, double gamma = 1.0) {
+        scoped_timer timer{"planNextAction"};
+        if (tableParameters) {
+            tableParameters->envStatus = envStatus;
+            if (classifyChanges(*tableParameters) != ParameterChange::NoChange)
+                tableParameters.reset();
+        }
+        if ((!tableParameters) || (transpositionTable.size() != std::bit_ceil(transpositionTableSize))) {
+            geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+            transpositionTable.clear();
+            transpositionTable.resize(std::bit_ceil(transpositionTableSize));
+            tableParameters = parameters();
+        }
 
-                    double equiprobableProbability;
-                    if (countOtherMovements > 0) {
-                        equiprobableProbability = equiprobableProbabilitySum / (countOtherMovements);
-                        for (auto& cp : G.adjacency_graph[S]) {
-                            for (SerializableRule& item : cp.second) {
-                                item.probability = equiprobableProbability;
-                            }
-                        }
-                    } else {
-                        eatingPreferranceIfIsPreferToEat = eatingPreferranceIfIsPreferToEat / EatAndUnloadVsRest;
-                        unloadPreferranceIfIsPreferToUnload = unloadPreferranceIfIsPreferToUnload / EatAndUnloadVsRest;
-                    }
+        PlannedAction result;
+        if ((horizon == 0) || (statusKind(envStatus) != StatusKind::ExpandableStatus))
+            return result;
+        result.expandedStates++;
+        ExpansionFrame& frame = expansionFrame(0);
+        generateSuccessors(envStatus, envStatus.currentCellCoord, frame.successors);
+        frame.successor = envStatus;
+        for (const Successor& cp : frame.successors) {
+            cp.second.apply(frame.successor);
+            double value = cp.first.feedback +
+                    gamma * expectedReturn(frame.successor, envStatus.currentCellCoord, horizon-1, gamma, 1, result);
+            cp.second.undo(frame.successor, envStatus);
+            if ((!result.found) || (value > result.value)) {
+                result.found = true;
+                result.rule = cp.first;
+                result.value = value;
+            }
+        }
+        return result;
+    }
 
+    /**
+     * Applies to S one of its rules, sampled according to the rule probabilities
+     *
+     * @param S             Status to be updated in place
+     * @param prevCell      Cell from which the robot reached S, updated with the cell of S
+     * @param random        Source of randomness
+     * @param successors    Memory reused across the steps
+     * @return  The applied rule, or nothing if S is final or none of its rules can be sampled
+     */
+    std::optional<SerializableRule> step(EnvironmentStatus& S,
+                                         std::pair<size_t, size_t>& prevCell,
+                                         std::mt19937_64& random,
+                                         std::vector<Successor>& successors) const {
+        if (statusKind(S) != StatusKind::ExpandableStatus)
+            return {};
+        generateSuccessors(S, prevCell, successors);
+        size_t chosen = sampleByProbability(successors.size(), [&successors](size_t i) {
+            return successors[i].first.probability;
+        }, random);
+        if (chosen == successors.size())
+            return {};
+        prevCell = S.currentCellCoord;
+        successors[chosen].second.apply(S);
+        return successors[chosen].first;
+    }
 
-                    // If the robot can use the energy in itself, then he can move!
-                    if (hasAnyMove) {
-                        // Normal pace movement
-
-                        for (const std::pair<Directions, std::pair<size_t, size_t>>& cell : allowedDirections) {
-                            EnvironmentStatus result = S;
-                            result.remaining_time--;
-                            result.satiety -= costNormalPace;
-                            result.currentCellCoord = cell.second;
-                            result.nActionsPerformed++;
-                            SerializableRule rule{RuleCases::Move, cell.first, false};
-                            rule.feedback = countWeightDifference(S, result);
-                            bool cellEating = (cell.first == priorityEatingCell);
-                            bool cellUnload = (cell.first == priorityUnloadCell);
-                            if (preferToEat || preferToUnload) {
-                                rule.probability = 0;
-                                if (cellEating)
-                                    rule.probability += eatingPreferranceIfIsPreferToEat;
-                                if (cellUnload)
-                                    rule.probability += unloadPreferranceIfIsPreferToUnload;
-                                if ((!cellEating) && (!cellUnload)) {
-                                    assert(countOtherMovements > 0);
-                                    rule.probability = equiprobableProbability;
-                                }
-                            } else {
-                                assert(countOtherMovements > 0);
-                                rule.probability = equiprobableProbability;
-                            }
-                            G.adjacency_graph[S][result].emplace_back(rule);
-                            dstId = generateStateId(result);
-                            if (debug) os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                            DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                        }
+    /**
+     * @param n             Number of elements
+     * @param probability   Of the i-th element, not necessarily normalised
+     * @param random        Source of randomness
+     * @return  Position of an element sampled according to its probability, or n if the probability mass is zero
+     */
+    template <typename Probability>
+    static size_t sampleByProbability(size_t n, Probability&& probability, std::mt19937_64& random) {
+        double mass = 0.0;
+        for (size_t i = 0; i<n; i++)
+            mass += probability(i);
+        if (mass <= 0.0)
+            return n;
+        double sampled = std::uniform_real_distribution<double>{0.0, mass}(random);
+        size_t chosen = n;
+        for (size_t i = 0; i<n; i++) {
+            double p = probability(i);
+            if (p <= 0.0) continue;
+            chosen = i;
+            if (sampled < p) break;
+            sampled -= p;
+        }
+        return chosen;
+    }
 
-                        if (doFastPace) {
-                            for (const std::pair<Directions, std::pair<size_t, size_t>>& cell : allowedDirections) {
-                                EnvironmentStatus result = S;
-                                result.remaining_time-=0.5;
-                                result.satiety -= costFastPace;
-                                result.currentCellCoord = cell.second;
-                                SerializableRule rule{RuleCases::FastMove, cell.first, true};
-                                rule.feedback = countWeightDifference(S, result);
-                                bool cellEating = (cell.first == priorityEatingCell);
-                                bool cellUnload = (cell.first == priorityUnloadCell);
-                                if (preferToEat || preferToUnload) {
-                                    rule.probability = 0;
-                                    if (cellEating)
-                                        rule.probability += eatingPreferranceIfIsPreferToEat;
-                                    if (cellUnload)
-                                        rule.probability += unloadPreferranceIfIsPreferToUnload;
-                                    if ((!cellEating) && (!cellUnload))
-                                        rule.probability = equiprobableProbability;
-                                } else {
-                                    rule.probability = equiprobableProbability;
-                                }
-                                G.adjacency_graph[S][result].emplace_back(rule);
-                                dstId = generateStateId(result);
-                                os << srcId << "{" << S << "}--[" << rule << "]-->" << dstId << "{" << result << "}" << std::endl<< std::endl;
-                                DFSGeneratePossibleStates(os, G, result, S.currentCellCoord);
-                            }
-                        }
-                    }
+    /**
+     * @param S         Status from which a rule is sampled
+     * @param prevCell  Cell from which the robot reached S
+     * @param random    Source of randomness
+     * @return  The sampled rule together with the status it leads to, if any
+     */
+    std::optional<std::pair<SerializableRule, EnvironmentStatus>> step(const EnvironmentStatus& S,
+                                                                       std::pair<size_t, size_t> prevCell,
+                                                                       std::mt19937_64& random) const {
+        std::vector<Successor> successors;
+        EnvironmentStatus successor{S};
+        auto rule = step(successor, prevCell, random, successors);
+        if (!rule) return {};
+        return std::make_pair(*rule, std::move(successor));
+    }
+
+    /**
+     * Estimates the return of each rule applicable to envStatus via UCT, without generating the graph. As in
+     * planNextAction, the robot picks the rule at the root, while all the following rules are chosen with the
+     * probabilities of the preference model, both within the tree and in the simulations. So, the mean return of a
+     * root rule estimates the value planNextAction gives to it with the same horizon.
+     *
+     * @param parameters    Budget of the search
+     * @return  The statistics of the rules applicable to envStatus, in the same order as the graph edges
+     */
+    std::vector<ActionStatistics> searchNextAction(const UCTParameters& parameters) {
+        scoped_timer timer{"searchNextAction"};
+        geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+        size_t nThreads = std::max((size_t)1, std::min(parameters.threads, parameters.iterations));
+        std::vector<std::vector<ActionStatistics>> partial(nThreads);
+        auto search = [this, &parameters, &partial, nThreads](size_t threadId) {
+            size_t iterations = (parameters.iterations * (threadId+1)) / nThreads -
+                                (parameters.iterations * threadId) / nThreads;
+            partial[threadId] = uctSearch(parameters, iterations, parameters.seed + threadId);
+        };
+        std::vector<std::thread> threads;
+        for (size_t threadId = 1; threadId<nThreads; threadId++)
+            threads.emplace_back(search, threadId);
+        search(0);
+        for (std::thread& t : threads)
+            t.join();
+
+        // The root rules are generated in the same order by all the threads
+        std::vector<ActionStatistics> result = partial[0];
+        for (size_t threadId = 1; threadId<nThreads; threadId++) {
+            for (size_t i = 0, N = std::min(result.size(), partial[threadId].size()); i<N; i++) {
+                const ActionStatistics& other = partial[threadId][i];
+                size_t visits = result[i].visits + other.visits;
+                if (visits > 0)
+                    result[i].meanReturn = (result[i].meanReturn * result[i].visits + other.meanReturn * other.visits) / visits;
+                result[i].visits = visits;
+            }
+        }
+        return result;
+    }
+
+    BoardParameters parameters() const {
+        return {envStatus, boardSize, unloadingCoordinate, fillingStationCoordinate,
+                gameProgressWeight, timeWeight, hungerWeight, maxSatiety, maxTime,
+                LogCellsPosition, StoneCellsPosition, EatVsUnloadPreferrance, EatAndUnloadVsRest,
+                allowFastMoves, pruneHopelessStates};
+    }
+
+    /**
+     * Determines which parts of a previously generated graph are affected by the edits performed since then
+     *
+     * @param previous  Parameters that were used to generate the graph
+     * @return  Bitwise or of the ParameterChange flags
+     */
+    int classifyChanges(const BoardParameters& previous) const {
+        int changes = ParameterChange::NoChange;
+        if ((gameProgressWeight != previous.gameProgressWeight) ||
+            (timeWeight != previous.timeWeight) ||
+            (hungerWeight != previous.hungerWeight))
+            changes |= ParameterChange::WeightsChanged;
+        if ((EatVsUnloadPreferrance != previous.EatVsUnloadPreferrance) ||
+            (EatAndUnloadVsRest != previous.EatAndUnloadVsRest))
+            changes |= ParameterChange::PreferencesChanged;
+        // maxSatiety and maxTime also determine the initial status, so any change to them reshapes the whole graph
+        if ((envStatus != previous.envStatus) ||
+            (boardSize != previous.boardSize) ||
+            (unloadingCoordinate != previous.unloadingCoordinate) ||
+            (fillingStationCoordinate != previous.fillingStationCoordinate) ||
+            (maxSatiety != previous.maxSatiety) ||
+            (maxTime != previous.maxTime) ||
+            (LogCellsPosition != previous.LogCellsPosition) ||
+            (StoneCellsPosition != previous.StoneCellsPosition) ||
+            (allowFastMoves != previous.allowFastMoves) ||
+            (pruneHopelessStates != previous.pruneHopelessStates))
+            changes |= ParameterChange::StructureChanged;
+        return changes;
+    }
+
+    /**
+     * Updates a graph generated with the previous parameters, so that it reflects the current ones. If only the
+     * weights or the preferences changed, the states are not explored again and only the edge attributes are
+     * recomputed; otherwise, the graph is generated from scratch.
+     *
+     * @param os        Where to write the generation log, if any
+     * @param G         Graph that was generated with the previous parameters
+     * @param previous  Parameters that were used to generate G
+     * @return  The changes that were detected
+     */
+    int updatePossibleStates(std::ostream& os, stateful_graph& G, const BoardParameters& previous) {
+        scoped_timer timer{"updatePossibleStates"};
+        int changes = classifyChanges(previous);
+        if (changes & ParameterChange::StructureChanged) {
+            G = generatePossibleStates(os);
+        } else if (changes != ParameterChange::NoChange) {
+            geometry.build(boardSize, fillingStationCoordinate, unloadingCoordinate);
+            bool updateFeedback = (changes & ParameterChange::WeightsChanged);
+            bool updateProbability = (changes & ParameterChange::PreferencesChanged);
+            for (auto& cpM : G.adjacency_graph) {
+                if (updateFeedback) {
+                    for (auto& cp2M : cpM.second)
+                        for (SerializableRule& rule : cp2M.second)
+                            rule.feedback = countWeightDifference(cpM.first, *cp2M.first);
+                }
+                if (updateProbability)
+                    updateRuleProbabilities(cpM.first, cpM.second);
+            }
+        }
+        return changes;
+    }
+
+private:
+
+    BoardGeometry geometry;
+
+    /**
+     * Preference-weighted probability distribution over the rules leaving a state
+     */
+    struct RuleDistribution {
+        bool preferToEat = false;           // Prioritize the move towards the gas station
+        bool preferToUnload = false;        // Prioritize the move towards the unloading zone
+        bool doFastPace = false;
+        bool hasAnyMove = false;
+        Directions priorityEatingCell = N, priorityUnloadCell = N;
+        double eatingPreferranceIfIsPreferToEat = 0.0;
+        double unloadPreferranceIfIsPreferToUnload = 0.0;
+        double countOtherMovements = 0.0;
+        double equiprobableProbability = 0.0;
+        double costNormalPace = 1.0;
+        double costFastPace = 2.0;
+
+        /**
+         * @param dir   Direction of a (normal or fast) movement
+         * @return  Probability associated to the movement rule
+         */
+        double moveProbability(Directions dir) const {
+            bool cellEating = preferToEat && (dir == priorityEatingCell);
+            bool cellUnload = preferToUnload && (dir == priorityUnloadCell);
+            if ((!cellEating) && (!cellUnload)) {
+                assert(countOtherMovements > 0);
+                return equiprobableProbability;
+            }
+            double probability = 0;
+            if (cellEating)
+                probability += eatingPreferranceIfIsPreferToEat;
+            if (cellUnload)
+                probability += unloadPreferranceIfIsPreferToUnload;
+            return probability;
+        }
+    };
+
+    /**
+     * Computes how the probability mass is distributed among the rules leaving the state
+     *
+     * @param S                     State being expanded
+     * @param allowedDirections     Movements that are allowed from S
+     * @param countNonMoveRules     Number of rules not involving a movement that were applied to S
+     * @return  The distribution to be used for the rules leaving S
+     */
+    RuleDistribution ruleDistribution(const EnvironmentStatus& S,
+                                      const AllowedMovements& allowedDirections,
+                                      size_t countNonMoveRules) const {
+        RuleDistribution result;
+        const BoardGeometry::Cell& cell = geometry.at(S.currentCellCoord);
+        double remainingProbability = 1.0;
+        result.countOtherMovements = (double)countNonMoveRules;
+
+        {
+            double tradeOff = 0.0;
+
+            if (cell.fillingStationDistance >= S.satiety) {
+                result.preferToEat = true;
+                result.eatingPreferranceIfIsPreferToEat = 1.0 - ((S.satiety)/(S.satiety+1.0));
+            }
+            if ((S.isLoadedOrEmpty != LoadType::FuelOrNoop)) {
+                result.preferToUnload = true;
+                result.unloadPreferranceIfIsPreferToUnload = cell.unloadingDistance;
+                result.unloadPreferranceIfIsPreferToUnload = (result.unloadPreferranceIfIsPreferToUnload/(result.unloadPreferranceIfIsPreferToUnload+1.0));
+            }
+            tradeOff = EatVsUnloadPreferrance * (result.eatingPreferranceIfIsPreferToEat) + (1.0-EatVsUnloadPreferrance) * result.unloadPreferranceIfIsPreferToUnload;
+            if (tradeOff > 0.0) {
+                result.eatingPreferranceIfIsPreferToEat = EatAndUnloadVsRest * EatVsUnloadPreferrance * (result.eatingPreferranceIfIsPreferToEat) / tradeOff;
+                result.unloadPreferranceIfIsPreferToUnload = EatAndUnloadVsRest * (1.0-EatVsUnloadPreferrance) * (result.unloadPreferranceIfIsPreferToUnload) / tradeOff;
+                remainingProbability -= result.eatingPreferranceIfIsPreferToEat;
+                remainingProbability -= result.unloadPreferranceIfIsPreferToUnload;
+            }
+        }
+
+        size_t hasAtLeastOnePreferredMovement = 0;
+        if (result.preferToEat && (!allowedDirections.empty())) {
+            result.priorityEatingCell = cell.towardsFillingStation[allowedDirections.excluded];
+        }
+        if (result.preferToUnload && (!allowedDirections.empty())) {
+            result.priorityUnloadCell = cell.towardsUnloading[allowedDirections.excluded];
+        }
+        if (result.preferToEat && result.preferToUnload) {
+            if (result.priorityEatingCell == result.priorityUnloadCell)
+                hasAtLeastOnePreferredMovement = 1;
+            else
+                hasAtLeastOnePreferredMovement = 2;
+        } else if (result.preferToEat || result.preferToUnload) {
+            hasAtLeastOnePreferredMovement = 1;
+        } else {
+            hasAtLeastOnePreferredMovement = 0;
+        }
+
+        // Increase the cost of moving if the robot is loaded
+        if (S.isLoadedOrEmpty != LoadType::FuelOrNoop) {
+            result.costNormalPace += 0.5;
+            result.costFastPace += 1.0;
+        }
+
+        result.doFastPace = allowFastMoves && (!allowedDirections.empty()) && (S.satiety >= result.costFastPace);
+        result.hasAnyMove = (!allowedDirections.empty()) && (S.satiety >= result.costNormalPace);
+
+        if (result.hasAnyMove) {
+            double equiprobableProbabilitySum = 1.0;
+            size_t totalUnprioritizedMovements = allowedDirections.size - hasAtLeastOnePreferredMovement;
+            if (result.preferToEat || result.preferToUnload) {
+                equiprobableProbabilitySum = remainingProbability;
+            } else {
+                equiprobableProbabilitySum = 1.0;
+            }
+            if (result.doFastPace) {
+                totalUnprioritizedMovements *= 2;
+                result.eatingPreferranceIfIsPreferToEat *= 0.5;
+                result.unloadPreferranceIfIsPreferToUnload *= 0.5;
+            }
+            result.countOtherMovements += totalUnprioritizedMovements;
+
+            if (result.countOtherMovements > 0) {
+                result.equiprobableProbability = equiprobableProbabilitySum / (result.countOtherMovements);
+            } else {
+                result.eatingPreferranceIfIsPreferToEat = result.eatingPreferranceIfIsPreferToEat / EatAndUnloadVsRest;
+                result.unloadPreferranceIfIsPreferToUnload = result.unloadPreferranceIfIsPreferToUnload / EatAndUnloadVsRest;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Recomputes the probabilities of the rules leaving a state that was already expanded. The allowed movements
+     * are the ones appearing as outgoing Move edges, as a state either has all of them or none: if one neighbour
+     * is missing, it is the one that was excluded for leading back to the previous cell.
+     *
+     * @param S         Expanded state
+     * @param outgoing  Edges leaving S
+     */
+    void updateRuleProbabilities(const EnvironmentStatus& S,
+                                 stateful_graph::outgoing_edges& outgoing) const {
+        const AllowedMovements& neighbours = geometry.at(S.currentCellCoord).neighbours;
+        std::array<bool, AllowedMovements::MaxDirections> isMoving{};
+        size_t countNonMoveRules = 0;
+        for (const auto& cp : outgoing) {
+            for (const SerializableRule& rule : cp.second) {
+                if (rule.casus == RuleCases::Move) {
+                    for (size_t i = 0; i < neighbours.size; i++)
+                        if (neighbours.cells[i].first == rule.movement)
+                            isMoving[i] = true;
+                } else if (rule.casus != RuleCases::FastMove)
+                    countNonMoveRules++;
+            }
+        }
+        AllowedMovements allowedDirections;
+        for (size_t i = 0; i < neighbours.size; i++) {
+            if (isMoving[i])
+                allowedDirections.cells[allowedDirections.size++] = neighbours.cells[i];
+            else
+                allowedDirections.excluded = i;
+        }
+        RuleDistribution distribution = ruleDistribution(S, allowedDirections, countNonMoveRules);
+        if (!distribution.hasAnyMove)
+            return; // No probability was assigned at generation time
+        for (auto& cp : outgoing) {
+            for (SerializableRule& rule : cp.second) {
+                if ((rule.casus == RuleCases::Move) || (rule.casus == RuleCases::FastMove))
+                    rule.probability = distribution.moveProbability(rule.movement);
+                else if (distribution.countOtherMovements > 0)
+                    rule.probability = distribution.equiprobableProbability;
+            }
+        }
+    }
+
+    /**
+     * Identifiers of the states met during a generation, which have their own arena as they are discarded as soon
+     * as the generation is over
+     */
+    struct StateIds {
+        graph_arena arena;
+        std::pmr::unordered_map<const EnvironmentStatus*, size_t> ids;     // By key of the graph being generated
+
+        explicit StateIds(AllocationMode mode) : arena{mode}, ids{arena.resource()} {}
+    };
+    std::optional<StateIds> M;
+    size_t generateStateId(const EnvironmentStatus& S) {
+        size_t Sx = 0;
+        auto it = M->ids.find(&S);
+        if (it == M->ids.end()) {
+            M->ids[&S] = Sx = M->ids.size();
+        } else {
+            Sx = it->second;
+        }
+        return Sx;
+    }
+
+    /**
+     * Lists the rules that can be applied to a status which is neither accepting nor failing, together with the
+     * change that each of them performs, in the same order in which they are explored
+     *
+     * @param S             Status being expanded
+     * @param prevCell      Cell from which the robot reached the current one
+     * @param successors    Where to store the rules (previous content is discarded, but not its memory)
+     * @return  Whether the robot has enough energy to move from S: if not, S is a failing status
+     */
+    bool generateSuccessors(const EnvironmentStatus& S,
+                            const std::pair<size_t, size_t>& prevCell,
+                            std::vector<Successor>& successors) const {
+        successors.clear();
+
+        if ((S.satiety >= 2.1) &&
+            (S.currentCellCoord == unloadingCoordinate) &&
+                S.isExactAmount()/*(std::find(S.UnloadZoneContent.begin(), S.UnloadZoneContent.end(), LoadType::OneStone)) != S.UnloadZoneContent.end()*/) {
+            StatusDelta result{S};
+            result.satiety -= 1.0;
+            result.nActionsPerformed++;
+            result.remaining_time--;
+            result.unloads = true;
+            result.unloadedItem = LoadType::FuelOrNoop;
+            if (S.isGameProgressPositive(true, LoadType::FuelOrNoop))
+                result.game_progress++;
+            successors.emplace_back(SerializableRule{RuleCases::UnloadResource}, result);
+        }
+
+        if ((S.satiety >= 0.1) &&
+            (S.currentCellCoord == unloadingCoordinate) &&
+            (S.isRightAmount())) {
+            StatusDelta result{S};
+            result.isIgnited = true;
+            result.nActionsPerformed++;
+            result.satiety -= 0.1;
+            result.remaining_time--;
+            if (S.isGameProgressPositive())
+                result.game_progress++;
+            successors.emplace_back(SerializableRule{RuleCases::Ignite}, result);
+        }
+
+        if ((S.isLoadedOrEmpty != LoadType::FuelOrNoop) &&
+                (S.currentCellCoord == unloadingCoordinate) &&
+                (S.satiety >= 0.1)) {
+            StatusDelta result{S};
+            result.unloads = true;
+            result.unloadedItem = S.isLoadedOrEmpty;
+            result.isLoadedOrEmpty = LoadType::FuelOrNoop;
+            result.remaining_time--;
+            result.nActionsPerformed++;
+            result.satiety -= 0.1;
+            if (S.isGameProgressPositive(true, S.isLoadedOrEmpty))
+                result.game_progress++;
+            successors.emplace_back(SerializableRule{RuleCases::UnloadResource}, result);
+        }
+
+        for (size_t i = 0, N = LogCellsPosition.size(); i<N; i++) {
+            const std::pair<size_t, size_t>& logCoord = LogCellsPosition.at(i);
+            if ((S.currentCellCoord == logCoord) && (S.LogCellsContent.at(i) > 0) && (S.isLoadedOrEmpty == LoadType::FuelOrNoop) && (S.satiety >= 0.1)) {
+                StatusDelta result{S};
+                result.isLoadedOrEmpty = LoadType::OneLog;
+                result.remaining_time--;
+                result.nActionsPerformed++;
+                result.takenLogCell = i;
+                result.satiety -= 0.1;
+                successors.emplace_back(SerializableRule{RuleCases::LoadResource}, result);
+            }
+        }
+
+        for (size_t i = 0, N = StoneCellsPosition.size(); i<N; i++) {
+            const std::pair<size_t, size_t>& stoneCoord = StoneCellsPosition.at(i);
+            if ((S.currentCellCoord == stoneCoord) && (S.StoneCellsContent.at(i) > 0) && (S.isLoadedOrEmpty == LoadType::FuelOrNoop) && (S.satiety >= 0.1)) {
+                StatusDelta result{S};
+                result.isLoadedOrEmpty = LoadType::OneStone;
+                result.remaining_time--;
+                result.nActionsPerformed++;
+                result.takenStoneCell = i;
+                result.satiety -= 0.1;
+                successors.emplace_back(SerializableRule{RuleCases::LoadResource}, result);
+            }
+        }
+
+        if ((S.currentCellCoord == fillingStationCoordinate) && (S.satiety < maxSatiety) && (S.satiety > 0.0)) {
+            StatusDelta result{S};
+            result.remaining_time--;
+            result.nActionsPerformed++;
+            result.satiety = std::min(maxSatiety, result.satiety+5.0);
+            successors.emplace_back(SerializableRule{RuleCases::GainEnergy}, result);
+        }
+
+        AllowedMovements allowedDirections = geometry.allowedMovements(S.currentCellCoord, prevCell);
+        RuleDistribution distribution = ruleDistribution(S, allowedDirections, successors.size());
+        for (Successor& cp : successors) {
+            if (distribution.hasAnyMove && (distribution.countOtherMovements > 0))
+                cp.first.probability = distribution.equiprobableProbability;
+            cp.first.feedback = countWeightDifference(S, cp.second);
+        }
+
+        // If the robot can use the energy in itself, then he can move!
+        if (distribution.hasAnyMove) {
+            // Normal pace movement
+            for (const std::pair<Directions, std::pair<size_t, size_t>>& cell : allowedDirections) {
+                StatusDelta result{S};
+                result.remaining_time--;
+                result.satiety -= distribution.costNormalPace;
+                result.currentCellCoord = cell.second;
+                result.nActionsPerformed++;
+                SerializableRule rule{RuleCases::Move, cell.first, false};
+                rule.feedback = countWeightDifference(S, result);
+                rule.probability = distribution.moveProbability(cell.first);
+                successors.emplace_back(rule, result);
+            }
+
+            if (distribution.doFastPace) {
+                for (const std::pair<Directions, std::pair<size_t, size_t>>& cell : allowedDirections) {
+                    StatusDelta result{S};
+                    result.remaining_time-=0.5;
+                    result.satiety -= distribution.costFastPace;
+                    result.currentCellCoord = cell.second;
+                    SerializableRule rule{RuleCases::FastMove, cell.first, true};
+                    rule.feedback = countWeightDifference(S, result);
+                    rule.probability = distribution.moveProbability(cell.first);
+                    successors.emplace_back(rule, result);
+                }
+            }
+        }
+        return distribution.hasAnyMove;
+    }
+
+    /**
+     * Lower bounds to what is still needed for igniting from a status: the robot is assumed to always take the
+     * shortest paths at the cheapest pace, and to load each missing item from the nearest cell still having one
+     */
+    struct CompletionBound {
+        bool enoughItems = true;        // Whether the cells still contain all the missing items
+        double time = 0.0;
+        double satiety = 0.0;
+    };
+
+    CompletionBound completionBound(const EnvironmentStatus& S) const {
+        CompletionBound result;
+        size_t logs = 0, stones = 0, fuel = 0;
+        for (const LoadType t : S.UnloadZoneContent) {
+            if (t == LoadType::OneLog)
+                logs++;
+            else if (t == LoadType::OneStone)
+                stones++;
+            else
+                fuel++;
+        }
+        size_t missingLogs = (logs < 2) ? 2 - logs : 0;
+        size_t missingStones = (stones < 3) ? 3 - stones : 0;
+        size_t missingFuel = (fuel < 1) ? 1 - fuel : 0;
+        size_t unloads = 0;
+        // The carried item only needs to be unloaded
+        if ((S.isLoadedOrEmpty == LoadType::OneLog) && (missingLogs > 0)) {
+            missingLogs--;
+            unloads++;
+        } else if ((S.isLoadedOrEmpty == LoadType::OneStone) && (missingStones > 0)) {
+            missingStones--;
+            unloads++;
+        }
+
+        // Each item is fetched from the unloading zone and brought back there, but the first one can be loaded on the way
+        size_t availableLogs = 0, availableStones = 0;
+        size_t logSteps = SIZE_MAX, stoneSteps = SIZE_MAX;
+        for (size_t i = 0, N = LogCellsPosition.size(); i<N; i++)
+            if (S.LogCellsContent.at(i) > 0) {
+                availableLogs += S.LogCellsContent.at(i);
+                logSteps = std::min(logSteps, stepDistance(LogCellsPosition.at(i), unloadingCoordinate));
+            }
+        for (size_t i = 0, N = StoneCellsPosition.size(); i<N; i++)
+            if (S.StoneCellsContent.at(i) > 0) {
+                availableStones += S.StoneCellsContent.at(i);
+                stoneSteps = std::min(stoneSteps, stepDistance(StoneCellsPosition.at(i), unloadingCoordinate));
+            }
+        result.enoughItems = (availableLogs >= missingLogs) && (availableStones >= missingStones);
+        if (!result.enoughItems)
+            return result;
+        size_t roundTrips = 0, longestTrip = 0;
+        if (missingLogs) {
+            roundTrips += 2 * missingLogs * logSteps;
+            longestTrip = logSteps;
+        }
+        if (missingStones) {
+            roundTrips += 2 * missingStones * stoneSteps;
+            longestTrip = std::max(longestTrip, stoneSteps);
+        }
+        size_t moves = geometry.at(S.currentCellCoord).unloadingSteps + roundTrips - 2 * longestTrip;
+        size_t loads = missingLogs + missingStones;
+        unloads += loads;
+
+        // Loading, unloading and igniting take one time unit and 0.1 satiety each, while unloading the fuel takes 1.0
+        result.time = ((double)moves) * (allowFastMoves ? 0.5 : 1.0) + (double)(loads + unloads + missingFuel + 1);
+        result.satiety = (double)moves + 0.1 * (double)(loads + unloads + 1) + 1.0 * (double)missingFuel;
+        return result;
+    }
+
+    /**
+     * Admissible test for the states worth expanding: if it fails, no sequence of rules leads from S to acceptance.
+     * The robot running short of food is only doomed if it cannot reach the filling station either.
+     */
+    bool canStillIgnite(const EnvironmentStatus& S) const {
+        constexpr double tolerance = 1e-6;      // Satiety and time are sums of decimal costs
+        CompletionBound bound = completionBound(S);
+        if ((!bound.enoughItems) || (S.remaining_time + tolerance < bound.time))
+            return false;
+        if (S.satiety + tolerance >= bound.satiety)
+            return true;
+        // Reaching the station with no food left is a failure
+        size_t steps = geometry.at(S.currentCellCoord).fillingStationSteps;
+        return (steps == 0) || (S.satiety + tolerance > (double)steps);
+    }
+
+    /**
+     * Memory reused while expanding the states at a given recursion depth
+     */
+    struct ExpansionFrame {
+        EnvironmentStatus successor;            // Copy of the expanded status, updated in place by each rule
+        std::vector<Successor> successors;
+    };
+    std::deque<ExpansionFrame> frames;          // Growing a deque does not invalidate the frames in use
+
+    ExpansionFrame& expansionFrame(size_t depth) {
+        while (frames.size() <= depth)
+            frames.emplace_back();
+        return frames[depth];
+    }
+
+    /**
+     * Direct-mapped memo of the expected returns: a new value always replaces the one in its slot
+     */
+    struct TranspositionEntry {
+        bool isUsed = false;
+        size_t fingerprint = 0;
+        EnvironmentStatus status;
+        std::pair<size_t, size_t> prevCell;
+        size_t horizon = 0;
+        double value = 0.0;
+    };
+    std::vector<TranspositionEntry> transpositionTable;
+    std::optional<BoardParameters> tableParameters;     // Parameters with which the memoised values were computed
+
+    /**
+     * @param S         Status reached after applying a rule
+     * @param prevCell  Cell from which the robot reached the current one
+     * @param horizon   Maximum number of rules that can still be applied
+     * @param gamma     Discount factor of the feedback
+     * @param depth     Number of rules applied since the planning status
+     * @param stats     Where to count the expanded states and the memoised values being reused
+     * @return  The expected return of S, when the rules are chosen according to their probability
+     */
+    double expectedReturn(const EnvironmentStatus& S, const std::pair<size_t, size_t>& prevCell, size_t horizon,
+                          double gamma, size_t depth, PlannedAction& stats) {
+        // The accepting status is detected via isIgnited, which is not part of the status equality
+        if ((horizon == 0) || (statusKind(S) != StatusKind::ExpandableStatus))
+            return 0.0;
+        size_t fingerprint = yaucl::hashing::hash_combine(
+                yaucl::hashing::hash_combine(std::hash<EnvironmentStatus>{}(S), prevCell), horizon);
+        TranspositionEntry& entry = transpositionTable[fingerprint & (transpositionTable.size()-1)];
+        if (entry.isUsed && (entry.fingerprint == fingerprint) && (entry.horizon == horizon) &&
+            (entry.prevCell == prevCell) && (entry.status == S)) {
+            stats.tableHits++;
+            return entry.value;
+        }
+
+        stats.expandedStates++;
+        ExpansionFrame& frame = expansionFrame(depth);
+        generateSuccessors(S, prevCell, frame.successors);
+        frame.successor = S;
+        double value = 0.0;
+        for (const Successor& cp : frame.successors) {
+            cp.second.apply(frame.successor);
+            value += cp.first.probability *
+                    (cp.first.feedback + gamma * expectedReturn(frame.successor, S.currentCellCoord, horizon-1, gamma, depth+1, stats));
+            cp.second.undo(frame.successor, S);
+        }
+
+        // The recursive calls might have used the same slot in the meanwhile, which is now overwritten
+        entry.isUsed = true;
+        entry.fingerprint = fingerprint;
+        entry.status = S;
+        entry.prevCell = prevCell;
+        entry.horizon = horizon;
+        entry.value = value;
+        return value;
+    }
+
+    /**
+     * Node of a UCT tree, where children are stored contiguously in the same vector as their parent
+     */
+    struct UCTNode {
+        Successor move;                 // Rule leading from the parent to this node, and the change it performs
+        bool isExpanded = false;
+        size_t firstChild = 0;
+        size_t nChildren = 0;
+        size_t visits = 0;
+        double totalReturn = 0.0;
+
+        UCTNode(const Successor& move) : move{move} {}
+        UCTNode(const UCTNode& ) = default;
+        UCTNode(UCTNode&& ) = default;
+        UCTNode& operator=(const UCTNode& ) = default;
+        UCTNode& operator=(UCTNode&& ) = default;
+    };
 
-                    double testProbability = 0.0;
-                    for (auto& cp : G.adjacency_graph[S]) {
-                        for (SerializableRule& item : cp.second) {
-                            testProbability += item.probability;
+    /**
+     * Grows a single UCT tree from envStatus. The root rules are selected with UCB1, while the nodes below it are
+     * chance nodes, whose children are sampled with their probability. As each node is reached by applying the
+     * changes along its path, the tree does not store any status.
+     *
+     * @param parameters    Tuning of the search
+     * @param iterations    Number of simulations to be run
+     * @param seed          Seed of the simulations
+     * @return  The statistics of the root rules
+     */
+    std::vector<ActionStatistics> uctSearch(const UCTParameters& parameters, size_t iterations, uint_fast64_t seed) const {
+        scoped_timer timer{"uctSearch"};
+        std::mt19937_64 random{seed};
+        std::vector<UCTNode> tree;
+        tree.emplace_back(Successor{SerializableRule{}, StatusDelta{envStatus}});
+        std::vector<Successor> successors;
+        std::vector<size_t> path;
+        std::vector<double> rewards;
+        EnvironmentStatus current{envStatus};
+
+        for (size_t iteration = 0; iteration<iterations; iteration++) {
+            current = envStatus;
+            std::pair<size_t, size_t> prevCell = envStatus.currentCellCoord;
+            path.assign(1, 0);
+            rewards.clear();
+
+            // Selection and expansion: descending the tree until a node is visited for the first time
+            size_t node = 0;
+            while (statusKind(current) == StatusKind::ExpandableStatus) {
+                if (!tree[node].isExpanded) {
+                    generateSuccessors(current, prevCell, successors);
+                    tree[node].isExpanded = true;
+                    tree[node].firstChild = tree.size();
+                    tree[node].nChildren = successors.size();
+                    for (const Successor& cp : successors)
+                        tree.emplace_back(cp);
+                }
+                if ((tree[node].nChildren == 0) || (path.size() > parameters.horizon)) break;
+                size_t chosen = tree[node].firstChild;
+                if (node == 0) {
+                    double best = -std::numeric_limits<double>::infinity();
+                    double logVisits = std::log((double)std::max((size_t)1, tree[node].visits));
+                    for (size_t child = tree[node].firstChild, end = child + tree[node].nChildren; child<end; child++) {
+                        if (tree[child].visits == 0) {
+                            chosen = child;
+                            break;
+                        }
+                        double ucb = tree[child].totalReturn / tree[child].visits +
+                                     parameters.exploration * std::sqrt(logVisits / tree[child].visits);
+                        if (ucb > best) {
+                            best = ucb;
+                            chosen = child;
                         }
                     }
-                    if (std::abs(testProbability - 1.0) > std::numeric_limits<double>::epsilon())
-                        assert(std::abs(testProbability - 1.0) <= 0.000000000000001);
-
-                    ///os.flush();
+                } else {
+                    size_t sampled = sampleByProbability(tree[node].nChildren, [&tree, node](size_t i) {
+                        return tree[tree[node].firstChild + i].move.first.probability;
+                    }, random);
+                    if (sampled == tree[node].nChildren) break;     // As step, when no rule can be sampled
+                    chosen += sampled;
                 }
+                prevCell = current.currentCellCoord;
+                tree[chosen].move.second.apply(current);
+                rewards.emplace_back(tree[chosen].move.first.feedback);
+                path.emplace_back(chosen);
+                node = chosen;
+                if (tree[chosen].visits == 0) break;
+            }
 
-                ///os.flush();
+            // Simulation: sampling the rules from the preference model, until the horizon
+            double rollout = 0.0, discount = 1.0;
+            for (size_t i = path.size()-1; i<parameters.horizon; i++) {
+                auto rule = step(current, prevCell, random, successors);
+                if (!rule) break;
+                rollout += discount * rule->feedback;
+                discount *= parameters.gamma;
+            }
 
+            // Backpropagation: each node is given the return obtained from the rule leading to it onwards
+            double value = rollout;
+            for (size_t i = path.size(); i-- > 0; ) {
+                if (i > 0)
+                    value = rewards[i-1] + parameters.gamma * value;
+                tree[path[i]].visits++;
+                tree[path[i]].totalReturn += value;
             }
+        }
 
-            ///os.flush();
-            ///std::cout << std::endl;
+        std::vector<ActionStatistics> result;
+        for (size_t child = tree[0].firstChild, end = child + tree[0].nChildren; child<end; child++) {
+            ActionStatistics& stats = result.emplace_back();
+            stats.rule = tree[child].move.first;
+            stats.visits = tree[child].visits;
+            stats.meanReturn = stats.visits ? tree[child].totalReturn / stats.visits : 0.0;
+        }
+        return result;
+    }
+
+    /**
+     * Completes the counters with the current status of the graph, and reports them
+     */
+    void reportProgress(const stateful_graph& G) {
+        counters.loadFactor = G.adjacency_graph.load_factor();
+        counters.bucketCount = G.adjacency_graph.bucket_count();
+        counters.memory = G.memoryStats();
+        counters.elapsedSeconds = progressTimer.elapsedSeconds();
+        if (onProgress)
+            onProgress(counters);
+    }
+
+    /**
+     * Expands a status which was just added to the graph, and then all the new statuses it leads to. Each successor
+     * is looked up as the expanded status plus the change of a rule, so that only the statuses that were not met
+     * before are built and copied into the graph.
+     *
+     * @param S         Key of the graph
+     * @param outgoing  Edges leaving S, which are still to be generated
+     */
+    void DFSGeneratePossibleStates(std::ostream& os, stateful_graph& G, const EnvironmentStatus& S,
+                                   stateful_graph::outgoing_edges& outgoing,
+                                   const std::pair<size_t, size_t>& prevCell, size_t depth = 0) {
+        size_t srcId = generateStateId(S);
+        /*if (srcId >500000) {
+            os.flush();
+            return;
+        }*/
+        ///std::cout << " * " << srcId << std::endl;
+        size_t dstId;
+
+        //std::cout << S << std::endl;
+        StatusKind kind = statusKind(S);
+        if constexpr (instrumentation_enabled) {
+            counters.expandedStates++;
+            counters.depth = depth;
+            counters.maxDepth = std::max(counters.maxDepth, depth);
+            if (kind == StatusKind::AcceptingStatus)
+                counters.acceptingStates++;
+            else if (kind == StatusKind::FailingStatus)
+                counters.failingStates++;
+            if (progressTimer.isDue())
+                reportProgress(G);
+        }
+        if (kind == StatusKind::AcceptingStatus) {
+            os << "Accepting state is reached! " << srcId << " with remaining time " << S.remaining_time << " and food " << S.satiety << std::endl;
+            G.accepting_states.insert(S);
+        } else if (kind == StatusKind::FailingStatus) {
+            ///os << "Failing state is reached! " << srcId << std::endl;
+            G.failing_states.insert(S);
+        } else if (pruneHopelessStates && (!canStillIgnite(S))) {
+            G.failing_states.insert(S);
+            G.counters.prunedStates++;
+            if constexpr (instrumentation_enabled)
+                counters.failingStates++;
+        } else {
+            ExpansionFrame& frame = expansionFrame(depth);
+            bool hasAnyMove = generateSuccessors(S, prevCell, frame.successors);
+            if (!hasAnyMove) {
+                ///os << "Failing state is reached! " << srcId << std::endl;
+                G.failing_states.insert(S);
+                if constexpr (instrumentation_enabled)
+                    counters.failingStates++;
+            }
+            if constexpr (instrumentation_enabled)
+                for (const Successor& cp : frame.successors)
+                    counters.successorsPerCase[cp.first.casus - RuleCases::NOOP]++;
+            G.counters.addExpandedState(frame.successors.size());
+
+            // Rehashing does not invalidate the references to the map elements
+            size_t contents = status_hash::contents(S);
+            bool isCopied = false;
+            for (const Successor& cp : frame.successors) {
+                status_successor successor{S, cp.second, contents};
+                auto it = G.adjacency_graph.find(successor);
+                bool isNew = (it == G.adjacency_graph.end());
+                if (isNew) {
+                    if (!isCopied) {
+                        frame.successor = S;
+                        isCopied = true;
+                    }
+                    cp.second.apply(frame.successor);
+                    it = G.adjacency_graph.try_emplace(frame.successor).first;
+                    cp.second.undo(frame.successor, S);
+                    assert(status_hash::of(it->first) == successor.hash);
+                } else if constexpr (instrumentation_enabled) {
+                    ///std::cout << " Already Met = " << srcId << std::endl;
+                    counters.duplicateHits++;
+                }
+                stateful_graph::rulesTo(outgoing, &it->first).emplace_back(cp.first);
+                if (debug) {
+                    dstId = generateStateId(it->first);
+                    os << srcId << "{" << S << "}--[" << cp.first << "]-->" << dstId << "{" << it->first << "}" << std::endl<< std::endl;
+                }
+                if (isNew)
+                    DFSGeneratePossibleStates(os, G, it->first, it->second, S.currentCellCoord, depth+1);
+            }
+            // The outgoing probability mass is checked afterwards, by validateProbabilityMass
         }
     }
 
 };
 
 #include <fstream>
+#include <chrono>
+#include <cstdio>
+
+/**
+ * Writes the layers one after the other in a binary file, only keeping what the value computation needs: whether each
+ * state is expandable, and the probability, feedback and target of its rules
+ */
+struct layer_file_writer {
+    std::ofstream out;
+    std::vector<std::pair<int64_t, std::streamoff>> index;     // Ticks of each layer, and where it starts
+    int64_t maxDrop = 0;                                        // Most ticks consumed by a rule
+
+    explicit layer_file_writer(const std::string& path) : out{path, std::ios::binary} {}
+
+    template <typename T>
+    void put(const T& x) {
+        out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+
+    void write(const time_layer& layer) {
+        index.emplace_back(layer.ticks, (std::streamoff)out.tellp());
+        put(layer.ticks);
+        put((uint64_t)layer.size());
+        for (size_t i = 0, N = layer.size(); i<N; i++) {
+            put((uint8_t)(layer.kinds[i] == StatusKind::ExpandableStatus));
+            put((uint32_t)(layer.offsets[i+1] - layer.offsets[i]));
+            for (size_t j = layer.offsets[i], M = layer.offsets[i+1]; j<M; j++) {
+                const time_layer::edge& e = layer.edges[j];
+                maxDrop = std::max(maxDrop, layer.ticks - e.targetTicks);
+                put(e.rule.probability);
+                put(e.rule.feedback);
+                put(e.targetTicks);
+                put(e.target);
+            }
+        }
+    }
+};
+
+/**
+ * Expected return of the initial status when the rules are chosen with their probability, as in planNextAction. The
+ * layers are read back from the last one written, so that only the values of the layers reachable by a single rule
+ * are kept in memory.
+ *
+ * @param path      File written by a layer_file_writer
+ * @param writer    Which wrote the file, providing where each layer starts
+ * @param gamma     Discount factor of the feedback
+ */
+double layeredExpectedReturn(const std::string& path, const layer_file_writer& writer, double gamma = 1.0) {
+    scoped_timer timer{"layeredExpectedReturn"};
+    std::ifstream in{path, std::ios::binary};
+    auto get = [&in](auto& x) {
+        in.read(reinterpret_cast<char*>(&x), sizeof(x));
+    };
+    std::map<int64_t, std::vector<double>> values;
+    for (auto it = writer.index.rbegin(); it != writer.index.rend(); it++) {
+        in.seekg(it->second);
+        int64_t ticks;
+        uint64_t N;
+        get(ticks);
+        get(N);
+        assert(ticks == it->first);
+        // The layers further than a rule away are not going to be read anymore
+        values.erase(values.begin(), values.lower_bound(ticks - writer.maxDrop));
+        std::vector<double>& current = values[ticks];
+        current.assign(N, 0.0);
+        for (uint64_t i = 0; i<N; i++) {
+            uint8_t isExpandable;
+            uint32_t edges;
+            get(isExpandable);
+            get(edges);
+            for (uint32_t j = 0; j<edges; j++) {
+                double probability, feedback;
+                int64_t targetTicks;
+                uint32_t target;
+                get(probability);
+                get(feedback);
+                get(targetTicks);
+                get(target);
+                current[i] += probability * (feedback + gamma * values.at(targetTicks).at(target));
+            }
+            // As in expectedReturn, a failing status has no value even if some rules leave it
+            if (!isExpandable) current[i] = 0.0;
+        }
+    }
+    return writer.index.empty() ? 0.0 : values.at(writer.index.front().first).at(0);
+}
+
+/**
+ * Writes the rule breakdown of all the states whose outgoing probability mass does not sum up to one
+ * @return Number of offending states
+ */
+size_t reportProbabilityViolations(std::ostream& os, const stateful_graph& G) {
+    compact_graph C{G};
+    auto violations = validateProbabilityMass(C);
+    for (const probability_violation& violation : violations)
+        violation.breakdown(os, C);
+    return violations.size();
+}
 
 int main(void) {
+    trace_recorder::global().start("robot");
     Board gameBoard{3, 3,
                     2, 1,
                     2, 2,
@@ -780,10 +2782,76 @@ int main(void) {
     //gameBoard.addStoneCell(3, 5, 1);
     //gameBoard.addStoneCell(9, 10, 3);
 
+    // All the graph nodes are freed together when the graph dies, so they can come from a monotonic arena
+    gameBoard.allocationMode = AllocationMode::ArenaAllocation;
+    if constexpr (instrumentation_enabled)
+        gameBoard.onProgress = [](const ExplorationCounters& counters) {
+            std::cerr << counters << std::endl;
+        };
+
     std::ofstream f{"testing.txt"};
     auto g = gameBoard.generatePossibleStates(f);
     std::cout << "Total States: " << g.adjacency_graph.size() << std::endl;
+    std::cout << " - Memory: " << g.memoryStats() << std::endl;
     std::cout << " - Winning States: " << ((double)g.accepting_states.size())/((double)g.adjacency_graph.size()) << std::endl;
     std::cout << " - Losing States: " << ((double)g.failing_states.size())/((double)g.adjacency_graph.size()) << std::endl;
     std::cout << " - Final States: " << ((double)(g.accepting_states.size()+g.failing_states.size()))/((double)g.adjacency_graph.size()) << std::endl;
+#ifndef NDEBUG
+    std::cout << " - Wrong Probability Distributions: " << reportProbabilityViolations(f, g) << std::endl;
+#endif
+    std::cout << analyseGraph(g) << std::endl;
+
+    // Tweaking weights and preferences only requires to update the edges of the already generated graph
+    BoardParameters previous = gameBoard.parameters();
+    gameBoard.timeWeight = 0.2;
+    gameBoard.EatVsUnloadPreferrance = 0.6;
+    int changes = gameBoard.updatePossibleStates(f, g, previous);
+    std::cout << "Updated States: " << g.adjacency_graph.size() << " (changes = " << changes << ")" << std::endl;
+#ifndef NDEBUG
+    std::cout << " - Wrong Probability Distributions: " << reportProbabilityViolations(f, g) << std::endl;
+#endif
+
+    // The in-game AI only needs the next action, which can be chosen by looking a few steps ahead
+    auto start = std::chrono::steady_clock::now();
+    PlannedAction next = gameBoard.planNextAction(8);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Next Action: " << next << " (" << elapsed.count() << " us)" << std::endl;
+
+    // Boards too large to be enumerated can be still sampled
+    UCTParameters budget;
+    budget.iterations = 20000;
+    budget.threads = std::thread::hardware_concurrency();
+    start = std::chrono::steady_clock::now();
+    auto statistics = gameBoard.searchNextAction(budget);
+    elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Sampled Actions (" << elapsed.count() << " us):" << std::endl;
+    for (const ActionStatistics& action : statistics)
+        std::cout << " - " << action << std::endl;
+
+    // Planning only needs the states from which the robot can still ignite
+    g = {};
+    gameBoard.pruneHopelessStates = true;
+    auto relevant = gameBoard.generatePossibleStates(f);
+    std::cout << "Relevant States: " << relevant.adjacency_graph.size() << " (pruned: "
+              << relevant.counters.prunedStates << ")" << std::endl;
+    std::cout << analyseGraph(relevant) << std::endl;
+
+    // Boards not fitting in memory can be explored one time layer at a time, with the layers kept on disk
+    relevant = {};
+    layer_file_writer writer{"layers.bin"};
+    size_t widestLayer = 0;
+    size_t layeredStates = gameBoard.generateLayers([&](const time_layer& layer) {
+        writer.write(layer);
+        widestLayer = std::max(widestLayer, layer.size());
+    });
+    writer.out.close();
+    std::cout << "Layered States: " << layeredStates << " (layers: " << writer.index.size() << ", widest: "
+              << widestLayer << ")" << std::endl;
+    std::cout << " - Expected Return: " << layeredExpectedReturn("layers.bin", writer) << std::endl;
+    std::remove("layers.bin");
+
+    // Boards whose layers do not fit in memory either detect the duplicate states on disk
+    external_memory_parameters external;
+    external.batchStates = 1 << 12;
+    std::cout << "External States: " << gameBoard.generateExternally(external) << std::endl;
 }
\ No newline at end of file
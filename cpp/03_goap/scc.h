@@ -0,0 +1,151 @@
+//
+// Strongly connected components, for solving the value of the states one component at a time
+//
+
+#ifndef GOAP_SCC_H
+#define GOAP_SCC_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Components numbered in reverse topological order: the edges leaving a component only reach components with a
+ * smaller number, so that solving them by increasing number always finds the successors already solved.
+ */
+struct strongly_connected_components {
+    std::vector<uint32_t> component;    // Of each node
+    std::vector<size_t> offsets;        // The nodes of the c-th component are in [offsets[c], offsets[c+1])
+    std::vector<uint32_t> members;
+    std::vector<bool> cyclic;           // Whether the component has more than one node, or a self loop
+
+    size_t size() const {
+        return cyclic.size();
+    }
+
+    std::span<const uint32_t> nodes(size_t c) const {
+        return {members.data() + offsets[c], offsets[c+1] - offsets[c]};
+    }
+
+    /**
+     * @return For each component, the length of the longest chain of components it leads to. Components with the
+     *         same level never reach each other, so they can be solved at the same time
+     */
+    template <typename Offset>
+    std::vector<uint32_t> levels(const std::vector<Offset>& edgeOffsets, const std::vector<uint32_t>& targets) const {
+        std::vector<uint32_t> result(size(), 0);
+        for (size_t c = 0; c<size(); c++)
+            for (uint32_t node : nodes(c))
+                for (size_t j = edgeOffsets[node], M = edgeOffsets[node+1]; j<M; j++)
+                    if (component[targets[j]] != c)
+                        result[c] = std::max(result[c], result[component[targets[j]]] + 1);
+        return result;
+    }
+};
+
+/**
+ * Tarjan's algorithm, with an explicit stack of the edges still to be visited, so that the depth of the graph is
+ * not bounded by the call stack
+ *
+ * @param edgeOffsets   The edges of the i-th node are in [edgeOffsets[i], edgeOffsets[i+1])
+ * @param targets       Node reached by each edge
+ */
+template <typename Offset>
+strongly_connected_components tarjan(const std::vector<Offset>& edgeOffsets, const std::vector<uint32_t>& targets) {
+    constexpr uint32_t unvisited = UINT32_MAX;
+    size_t N = edgeOffsets.size()-1;
+    strongly_connected_components result;
+    result.component.assign(N, unvisited);
+    result.offsets.push_back(0);
+    result.members.reserve(N);
+
+    std::vector<uint32_t> index(N, unvisited), lowlink(N, 0);
+    std::vector<uint32_t> stack;                            // Nodes whose component is not known yet
+    std::vector<std::pair<uint32_t, size_t>> calls;         // Node, and its next edge to be visited
+    uint32_t nextIndex = 0;
+    for (size_t root = 0; root<N; root++) {
+        if (index[root] != unvisited) continue;
+        calls.emplace_back((uint32_t)root, edgeOffsets[root]);
+        index[root] = lowlink[root] = nextIndex++;
+        stack.push_back((uint32_t)root);
+        while (!calls.empty()) {
+            auto& [node, edge] = calls.back();
+            if (edge < edgeOffsets[node+1]) {
+                uint32_t next = targets[edge++];
+                if (index[next] == unvisited) {
+                    index[next] = lowlink[next] = nextIndex++;
+                    stack.push_back(next);
+                    calls.emplace_back(next, edgeOffsets[next]);
+                } else if (result.component[next] == unvisited) {
+                    lowlink[node] = std::min(lowlink[node], index[next]);
+                }
+                continue;
+            }
+            uint32_t done = node;
+            calls.pop_back();
+            if (!calls.empty())
+                lowlink[calls.back().first] = std::min(lowlink[calls.back().first], lowlink[done]);
+            if (lowlink[done] != index[done]) continue;
+
+            // done is the root of a component, made of the nodes above it in the stack
+            uint32_t c = (uint32_t)result.cyclic.size();
+            bool selfLoop = false;
+            uint32_t member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                result.component[member] = c;
+                result.members.push_back(member);
+            } while (member != done);
+            for (size_t j = edgeOffsets[done], M = edgeOffsets[done+1]; j<M; j++)
+                selfLoop = selfLoop || (targets[j] == done);
+            result.offsets.push_back(result.members.size());
+            result.cyclic.push_back(selfLoop || (result.offsets[c+1] - result.offsets[c] > 1));
+        }
+    }
+    return result;
+}
+
+/**
+ * Calls solve on each component, after all the components it leads to. The components of the same level are
+ * distributed among the threads.
+ *
+ * @param solve     Called with the number of the component
+ */
+template <typename Offset, typename Solve>
+void solve_by_components(const strongly_connected_components& C,
+                         const std::vector<Offset>& edgeOffsets,
+                         const std::vector<uint32_t>& targets,
+                         Solve&& solve,
+                         size_t nThreads = std::thread::hardware_concurrency()) {
+    std::vector<uint32_t> level = C.levels(edgeOffsets, targets);
+    std::vector<uint32_t> byLevel(C.size());
+    for (size_t c = 0; c<C.size(); c++)
+        byLevel[c] = (uint32_t)c;
+    std::stable_sort(byLevel.begin(), byLevel.end(), [&level](uint32_t lhs, uint32_t rhs) {
+        return level[lhs] < level[rhs];
+    });
+    nThreads = std::max((size_t)1, nThreads);
+    for (size_t begin = 0, end; begin<byLevel.size(); begin = end) {
+        for (end = begin+1; (end<byLevel.size()) && (level[byLevel[end]] == level[byLevel[begin]]); end++);
+        size_t T = std::min(nThreads, (end - begin) / 64 + 1);      // Small levels are not worth a thread
+        std::atomic<size_t> next{begin};
+        auto run = [&] {
+            for (size_t k = next++; k<end; k = next++)
+                solve(byLevel[k]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t<T; t++)
+            threads.emplace_back(run);
+        run();
+        for (std::thread& t : threads)
+            t.join();
+    }
+}
+
+#endif //GOAP_SCC_H
@@ -8,14 +8,19 @@
 #include <vector>
 #include <ostream>
 #include <iostream>
+#include <memory_resource>
+#include "arena.h"
+#include "symbol_table.h"
+#include "instrumentation.h"
+#include "trace.h"
 
 struct action {
-    std::string name;
+    symbol      name;
     double      probability;
     double      reward;
 
     action() : action("noop", 1.0, 0) {}
-    action(const std::string &name, double probability, double reward) : name(name), probability(probability),
+    action(const symbol &name, double probability, double reward) : name(name), probability(probability),
                                                                          reward(reward) {}
     action(const action& ) = default;
     action(action&& ) = default;
@@ -29,19 +34,39 @@ struct action {
 };
 
 struct stateful_graph {
-    std::unordered_set<std::string> allStates;
-    std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_map<std::string, action>>> adjacency_graph;
-    std::unordered_set<std::string> accepting_states;
-    std::string initial_state;
+    std::shared_ptr<graph_arena> arena;     // Declared first, so that it outlives the containers using it
+    std::pmr::unordered_set<symbol> allStates;
+    std::pmr::unordered_map<symbol, std::pmr::unordered_map<symbol, std::pmr::unordered_map<symbol, action>>> adjacency_graph;
+    std::pmr::unordered_set<symbol> accepting_states;
+    symbol initial_state;
 
-    stateful_graph() = default;
-    stateful_graph(const stateful_graph& ) = default;
+    stateful_graph(AllocationMode mode = AllocationMode::DefaultAllocation) :
+            arena{std::make_shared<graph_arena>(mode)},
+            allStates{arena->resource()},
+            adjacency_graph{arena->resource()},
+            accepting_states{arena->resource()} {}
+    // Copies share the arena of the original graph
+    stateful_graph(const stateful_graph& x) :
+            arena{x.arena},
+            allStates{x.allStates, arena->resource()},
+            adjacency_graph{x.adjacency_graph, arena->resource()},
+            accepting_states{x.accepting_states, arena->resource()},
+            initial_state{x.initial_state} {}
     stateful_graph(stateful_graph&& ) = default;
-    stateful_graph& operator=(const stateful_graph& ) = default;
-    stateful_graph& operator=(stateful_graph&& ) = default;
+    // Assigning shares the arena of x as copying does, and replaces the graph only after the copy succeeded
+    stateful_graph& operator=(const stateful_graph& x) {
+        return rebuild_in_place(*this, stateful_graph{x});
+    }
+    stateful_graph& operator=(stateful_graph&& x) noexcept {
+        return rebuild_in_place(*this, std::move(x));
+    }
+
+    allocation_stats memoryStats() const {
+        return arena->stats();
+    }
 
-    std::unordered_set<std::string> getOutgoingActionNames(const std::string& stateName) const {
-        std::unordered_set<std::string> actionSet;
+    std::unordered_set<symbol> getOutgoingActionNames(const symbol& stateName) const {
+        std::unordered_set<symbol> actionSet;
         auto cp = adjacency_graph.find(stateName);
         if (cp != adjacency_graph.end())
         for (const auto& adj : cp->second) {
@@ -52,7 +77,7 @@ struct stateful_graph {
         return actionSet;
     }
 
-    double getCost(double gamma, double dstV, const std::string& src, const std::string& dst, const std::string& stateName) const {
+    double getCost(double gamma, double dstV, const symbol& src, const symbol& dst, const symbol& stateName) const {
         auto it = adjacency_graph.find(src);
         if (it == adjacency_graph.end()) return 0.0;
         auto it2 = it->second.find(dst);
@@ -65,13 +90,35 @@ struct stateful_graph {
 };
 
 #include <random>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include "scc.h"
+
+/**
+ * Counters of a sweep over all the states, only collected when compiling with GOAP_INSTRUMENTATION
+ */
+struct SweepCounters {
+    size_t sweep = 0;
+    size_t backups = 0;         // States whose value was updated
+    double residual = 0.0;      // Maximum change of a value within the sweep
+    double elapsedSeconds = 0.0;
+
+    friend std::ostream &operator<<(std::ostream &os, const SweepCounters &counters) {
+        os << "[" << counters.elapsedSeconds << " s] sweep: " << counters.sweep << " backups: " << counters.backups
+           << " residual: " << counters.residual;
+        return os;
+    }
+};
 
 struct PolicyIteration {
     const stateful_graph& G;
-    std::unordered_map<std::string, double> V;      // Greedy value associated to each state
-    std::unordered_map<std::string, std::unordered_map<std::string, double>> policy;
-    std::unordered_map<std::string, std::string> det_policy;
+    std::unordered_map<symbol, double> V;      // Greedy value associated to each state
+    std::unordered_map<symbol, std::unordered_map<symbol, double>> policy;
+    std::unordered_map<symbol, symbol> det_policy;
     const double gamma;
+    std::vector<SweepCounters> sweeps;                      // Of the last loop
+    std::function<void(const SweepCounters&)> onSweep;      // Called at the end of each sweep
 
     PolicyIteration(const stateful_graph &g, double gamma) : G(g), gamma{gamma} {
         double lower_bound = 0;
@@ -87,9 +134,18 @@ struct PolicyIteration {
     }
 
     void loop(double theta) {
+        scoped_timer timer{"PolicyIteration::loop"};
         double Delta;
+        progress_timer progress;
+        if constexpr (instrumentation_enabled)
+            sweeps.clear();
         do {
+            scoped_timer sweep{"sweep"};
             Delta = 0.0;
+            if constexpr (instrumentation_enabled) {
+                sweeps.emplace_back();
+                sweeps.back().sweep = sweeps.size();
+            }
             for (const auto& s : G.allStates) {
                 double v = V.at(s);
                 double argMax = -std::numeric_limits<double>::max();
@@ -106,13 +162,103 @@ struct PolicyIteration {
                     }
                     V[s] = argMax;
                     Delta = std::max(Delta, std::abs(v - argMax));
+                    if constexpr (instrumentation_enabled)
+                        sweeps.back().backups++;
                 }
             }
+            if constexpr (instrumentation_enabled) {
+                sweeps.back().residual = Delta;
+                sweeps.back().elapsedSeconds = progress.elapsedSeconds();
+                if (onSweep)
+                    onSweep(sweeps.back());
+            }
         } while (Delta > theta);
+        extractPolicy();
+    }
 
+    /**
+     * Solves one strongly connected component at a time, after all the components it leads to. A component without
+     * cycles is solved by backing up its only state once, while the states of the other ones are swept until their
+     * values change by no more than theta. Components which do not reach each other are solved in parallel.
+     */
+    void loop_by_components(double theta, size_t nThreads = std::thread::hardware_concurrency()) {
+        scoped_timer timer{"PolicyIteration::loop_by_components"};
+        progress_timer progress;
+        std::vector<symbol> states{G.allStates.begin(), G.allStates.end()};
+        std::unordered_map<symbol, uint32_t> ids;
+        for (uint32_t i = 0; i<states.size(); i++)
+            ids.emplace(states[i], i);
+        std::vector<size_t> offsets{0};
+        std::vector<uint32_t> targets;
+        for (const symbol& s : states) {
+            auto it = G.adjacency_graph.find(s);
+            if (it != G.adjacency_graph.end())
+                for (const auto& adj : it->second)
+                    targets.push_back(ids.at(adj.first));
+            offsets.push_back(targets.size());
+        }
+
+        strongly_connected_components components = tarjan(offsets, targets);
+        std::atomic<size_t> backups{0};
+        std::atomic<double> residual{0.0};
+        solve_by_components(components, offsets, targets, [&](size_t c) {
+            double Delta;
+            do {
+                Delta = 0.0;
+                for (uint32_t i : components.nodes(c)) {
+                    Delta = std::max(Delta, backup(states[i]));
+                    if constexpr (instrumentation_enabled)
+                        backups++;
+                }
+            } while (components.cyclic[c] && (Delta > theta));
+            if constexpr (instrumentation_enabled)
+                for (double max = residual; (Delta > max) && !residual.compare_exchange_weak(max, Delta); );
+        }, nThreads);
+
+        if constexpr (instrumentation_enabled) {
+            sweeps.clear();
+            SweepCounters& counters = sweeps.emplace_back();
+            counters.sweep = 1;
+            counters.backups = backups;
+            counters.residual = residual;
+            counters.elapsedSeconds = progress.elapsedSeconds();
+            if (onSweep)
+                onSweep(counters);
+        }
+        extractPolicy();
+    }
+
+private:
+    /**
+     * Updates the value of a state with the one of its best action, and leaves the states without actions alone.
+     * Only the value of the state is written, so that states can be backed up in parallel.
+     *
+     * @return How much the value changed
+     */
+    double backup(const symbol& s) {
+        auto it = G.adjacency_graph.find(s);
+        if (it == G.adjacency_graph.end()) return 0.0;
+        double argMax = -std::numeric_limits<double>::max();
+        for (const auto& actionName : G.getOutgoingActionNames(s)) {
+            double sum = 0.0;
+            for (const auto& adj : it->second) {
+                auto it2 = adj.second.find(actionName);
+                if (it2 != adj.second.end())
+                    sum += it2->second.probability * (it2->second.reward + gamma * V.at(adj.first));
+            }
+            argMax = std::max(argMax, sum);
+        }
+        double& v = V.at(s);
+        double change = std::abs(v - argMax);
+        v = argMax;
+        return change;
+    }
+
+    void extractPolicy() {
+        scoped_timer extraction{"policy extraction"};
         for (const auto& s : G.allStates) {
             double argMax = -std::numeric_limits<double>::max();
-            std::string argName = "";
+            symbol argName;
             for (const auto& actionName : G.getOutgoingActionNames(s)) {
                 double sum = 0.0;
                 for (const auto& sp : G.allStates) {
@@ -130,13 +276,14 @@ struct PolicyIteration {
 };
 
 int main(void) {
-    std::string reading_1 = "ReadingDay1";
-    std::string reading_2 = "ReadingDay2";
-    std::string reading_3 = "ReadingDay3";
-    std::string party_1 = "Party1";
-    std::string party_2 = "Party2";
-    std::string party_3 = "Party3";
-    std::string passed = "PassedExam";
+    trace_recorder::global().start("study_party");
+    symbol reading_1 = "ReadingDay1";
+    symbol reading_2 = "ReadingDay2";
+    symbol reading_3 = "ReadingDay3";
+    symbol party_1 = "Party1";
+    symbol party_2 = "Party2";
+    symbol party_3 = "Party3";
+    symbol passed = "PassedExam";
     stateful_graph G;
     G.allStates = {reading_1, reading_2, reading_3, party_1, party_2, party_3, passed};
     G.adjacency_graph[reading_1][reading_2]["study"] = {"study", 0.7, -2.0};
@@ -155,6 +302,10 @@ int main(void) {
     G.accepting_states.insert(passed);
 
     PolicyIteration policyIteration(G, 0.5);
+    if constexpr (instrumentation_enabled)
+        policyIteration.onSweep = [](const SweepCounters& counters) {
+            std::cerr << counters << std::endl;
+        };
     policyIteration.loop(0.01);
 
     for (const auto& cp : policyIteration.V)
@@ -166,4 +317,16 @@ int main(void) {
     for (const auto& cp : policyIteration.policy)
         for (const auto& cp2 : cp.second)
             std::cout << " Pi(" << cp.first << "|" << cp2.first << ")= " << cp2.second << std::endl;
+
+    // Only the headache loops need to be iterated, while the other states are backed up once
+    PolicyIteration byComponents(G, 0.5);
+    if constexpr (instrumentation_enabled)
+        byComponents.onSweep = [](const SweepCounters& counters) {
+            std::cerr << counters << std::endl;
+        };
+    byComponents.loop_by_components(0.01);
+    for (const auto& cp : byComponents.V)
+        std::cout << " Value by components (" << cp.first << ")= " << cp.second << std::endl;
+    for (const auto& cp : byComponents.det_policy)
+        std::cout << " Pi by components(" << cp.first << ")= " << cp.second << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+//
+// Names interned once, and referred by a small integer id
+//
+
+#ifndef GOAP_SYMBOL_TABLE_H
+#define GOAP_SYMBOL_TABLE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Each name is stored only once, and is associated to the order in which it was first met. As a deque never moves
+ * its elements when growing, the string views of the names stay valid as long as the table lives.
+ */
+struct symbol_table {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    symbol_table() {
+        intern("");     // The empty name is always associated to zero
+    }
+    symbol_table(const symbol_table& ) = delete;
+    symbol_table(symbol_table&& ) = delete;
+    symbol_table& operator=(const symbol_table& ) = delete;
+    symbol_table& operator=(symbol_table&& ) = delete;
+
+    uint32_t intern(std::string_view name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        uint32_t id = (uint32_t)names.size();
+        ids.emplace(names.emplace_back(name), id);
+        return id;
+    }
+
+    std::string_view name(uint32_t id) const {
+        return names.at(id);
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+};
+
+/**
+ * Name interned in the symbol table shared by the whole program, so that it is hashed and compared as an integer.
+ * Names are only expected to be interned while setting up the problem, and not concurrently.
+ */
+struct symbol {
+    uint32_t id;
+
+    symbol() : id{0} {}
+    symbol(std::string_view name) : id{table().intern(name)} {}
+    symbol(const std::string& name) : symbol{std::string_view{name}} {}
+    symbol(const char* name) : symbol{std::string_view{name}} {}
+    symbol(const symbol& ) = default;
+    symbol(symbol&& ) = default;
+    symbol& operator=(const symbol& ) = default;
+    symbol& operator=(symbol&& ) = default;
+
+    static symbol_table& table() {
+        static symbol_table symbols;
+        return symbols;
+    }
+
+    std::string_view name() const {
+        return table().name(id);
+    }
+
+    bool empty() const {
+        return id == 0;
+    }
+
+    bool operator==(const symbol &rhs) const {
+        return id == rhs.id;
+    }
+    bool operator!=(const symbol &rhs) const {
+        return id != rhs.id;
+    }
+    bool operator<(const symbol &rhs) const {
+        return id < rhs.id;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const symbol &s) {
+        return os << s.name();
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<symbol> {
+        size_t operator()(const symbol &x) const {
+            return x.id;
+        }
+    };
+}
+
+#endif //GOAP_SYMBOL_TABLE_H
@@ -0,0 +1,149 @@
+//
+// Scoped phase timers, exported as a Chrome trace-event file (chrome://tracing, https://ui.perfetto.dev)
+//
+
+#ifndef CSC3232_TRACE_H
+#define CSC3232_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct trace_event {
+    const char* name;       // Expected to be a string literal
+    const char* category;
+    double start_us;        // Since the beginning of the run
+    double duration_us;
+};
+
+/**
+ * Collects the timed phases of a run, and writes them when the program exits. Each thread records its events into
+ * its own buffer, which is shown as a separate track of the trace. Tracing is only enabled if the TRACE_DIR
+ * environment variable names the directory where the trace of each run is written.
+ */
+struct trace_recorder {
+    std::atomic<bool> enabled{false};
+    std::string path;
+    std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+    std::deque<std::vector<trace_event>> threads;   // Growing a deque does not invalidate the buffers in use
+
+    static trace_recorder& global() {
+        static trace_recorder recorder;
+        return recorder;
+    }
+
+    trace_recorder() = default;
+    trace_recorder(const trace_recorder& ) = delete;
+    trace_recorder(trace_recorder&& ) = delete;
+    trace_recorder& operator=(const trace_recorder& ) = delete;
+    trace_recorder& operator=(trace_recorder&& ) = delete;
+    ~trace_recorder() {
+        write();
+    }
+
+    /**
+     * Enables the tracing if TRACE_DIR is set
+     *
+     * @param program   Prefix of the trace file, which is followed by the start time of the run
+     * @return Whether the tracing is enabled
+     */
+    bool start(const std::string& program) {
+        const char* directory = std::getenv("TRACE_DIR");
+        if ((!directory) || (!*directory)) return false;
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        path = std::string{directory} + "/" + program + "." +
+               std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) + ".trace.json";
+        origin = std::chrono::steady_clock::now();
+        buffer();   // The thread starting the tracing is the first track
+        enabled = true;
+        return true;
+    }
+
+    /**
+     * @return The events recorded by the current thread
+     */
+    std::vector<trace_event>& buffer() {
+        thread_local std::vector<trace_event>* local = nullptr;
+        if (!local) {
+            std::lock_guard<std::mutex> lock{mutex};
+            local = &threads.emplace_back();
+        }
+        return *local;
+    }
+
+    void record(const char* name, const char* category,
+                std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+        buffer().push_back({name, category,
+                            std::chrono::duration<double, std::micro>(begin - origin).count(),
+                            std::chrono::duration<double, std::micro>(end - begin).count()});
+    }
+
+    /**
+     * Writes all the events recorded so far, and disables the tracing. All the threads recording events are
+     * expected to be over.
+     */
+    void write() {
+        if (!enabled.exchange(false)) return;
+        std::lock_guard<std::mutex> lock{mutex};
+        std::ofstream file{path};
+        file << std::fixed;
+        file.precision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool isFirst = true;
+        for (size_t tid = 0, N = threads.size(); tid<N; tid++) {
+            file << (isFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                 << ",\"args\":{\"name\":\"" << (tid ? "thread " + std::to_string(tid) : std::string{"main"}) << "\"}}";
+            isFirst = false;
+            for (const trace_event& event : threads[tid]) {
+                file << ",\n{\"name\":\"";
+                escape(file, event.name);
+                file << "\",\"cat\":\"";
+                escape(file, event.category);
+                file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << event.start_us << ",\"dur\":"
+                     << event.duration_us << "}";
+            }
+        }
+        file << "\n]}" << std::endl;
+    }
+
+private:
+    static void escape(std::ostream& os, const char* text) {
+        for (; *text; text++) {
+            if ((*text == '"') || (*text == '\\')) os << '\\';
+            os << *text;
+        }
+    }
+};
+
+/**
+ * Records the time elapsed between its construction and its destruction as a phase of the trace
+ */
+struct scoped_timer {
+    const char* name;
+    const char* category;
+    bool isActive;
+    std::chrono::steady_clock::time_point begin;
+
+    explicit scoped_timer(const char* name, const char* category = "phase") :
+            name{name}, category{category}, isActive{trace_recorder::global().enabled} {
+        if (isActive)
+            begin = std::chrono::steady_clock::now();
+    }
+    scoped_timer(const scoped_timer& ) = delete;
+    scoped_timer(scoped_timer&& ) = delete;
+    scoped_timer& operator=(const scoped_timer& ) = delete;
+    scoped_timer& operator=(scoped_timer&& ) = delete;
+    ~scoped_timer() {
+        if (isActive)
+            trace_recorder::global().record(name, category, begin, std::chrono::steady_clock::now());
+    }
+};
+
+#endif //CSC3232_TRACE_H